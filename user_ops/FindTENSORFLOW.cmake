@@ -79,13 +79,13 @@ endif()
 macro(add_tensorflow_operation op_name)
   message(STATUS "will build custom TensorFlow operation \"${op_name}\"")
 
-  cuda_add_library(${op_name}_op_cu SHARED kernels/${op_name}_kernel.cu)
-  set_target_properties(${op_name}_op_cu PROPERTIES PREFIX "")
+  # the CUDA kernels are linked into the same library (no second shared object)
+  cuda_compile(${op_name}_cu_objects kernels/${op_name}_kernel.cu SHARED)
 
-  add_library(${op_name}_op SHARED kernels/${op_name}_op.cc kernels/${op_name}_kernel.cc ops/${op_name}.cc )
+  add_library(${op_name}_op SHARED kernels/${op_name}_op.cc kernels/${op_name}_kernel.cc ops/${op_name}.cc ${${op_name}_cu_objects})
 
   set_target_properties(${op_name}_op PROPERTIES PREFIX "")
-  target_link_libraries(${op_name}_op LINK_PUBLIC ${op_name}_op_cu ${TENSORFLOW_LIBRARY})
+  target_link_libraries(${op_name}_op LINK_PUBLIC ${CUDA_LIBRARIES} ${TENSORFLOW_LIBRARY})
 endmacro()
 
 include(FindPackageHandleStandardArgs)
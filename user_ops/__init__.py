@@ -1,24 +1,198 @@
 # ComputerGraphics Tuebingen, 2018
 
 # manually generated file
-import tensorflow as tf
+import functools
 import os
+import threading
+
+import tensorflow as tf
 from tensorflow.python.framework import ops
+from tensorflow.python.ops import gen_array_ops
+
+__all__ = ['matrix_add', 'matrix_add_grad', 'matrix_add_n', 'matrix_add_n_grad', 'matrix_add_grouped',
+           'matrix_add_sparse_grad', 'matrix_add_v2', 'matrix_add_v2_grad',
+           'matrix_add_host_a', 'matrix_add_optimizer_config', 'quantized_matrix_add',
+           'matrix_sub', 'matrix_mul', 'matrix_minimum', 'matrix_maximum', 'load_library']
+
+# "matrix_add_op.so" contains all ops of this package. It is loaded on first
+# use of one of them (registering the ops, kernels and the Grappler pass), so
+# importing the package does not pay for the dynamic linking of the library
+# and the registration of its kernels.
+_matrix_add_module = None
+_matrix_add_module_lock = threading.Lock()
+# wrappers of "_lazy_op" by the name of their op
+_lazy_ops = {}
+
+
+def load_library():
+    """Loads `matrix_add_op.so` (once) and returns its module.
+
+    Graphs imported from a GraphDef or SavedModel that contain the ops need
+    it to be loaded first, when none of the ops has been used before.
+    """
+    global _matrix_add_module
+    with _matrix_add_module_lock:
+        if _matrix_add_module is None:
+            path = os.path.join(os.path.dirname(__file__), 'matrix_add_op.so')
+            module = tf.load_op_library(path)
+            # from now on the wrappers have the names and docstrings of the
+            # generated ops (and their signatures on Python 3)
+            for name, op in _lazy_ops.items():
+                functools.update_wrapper(op, getattr(module, name))
+            _matrix_add_module = module
+    return _matrix_add_module
+
+
+def _lazy_op(name):
+    # wrapper of the generated op "name", which loads the library on first call
+    def op(*args, **kwargs):
+        return getattr(load_library(), name)(*args, **kwargs)
+    op.__name__ = name
+    op.__doc__ = 'See `%s` of `matrix_add_op.so`, which is loaded on first call.' % name
+    _lazy_ops[name] = op
+    return op
+
+
+matrix_add = _lazy_op('matrix_add')
+matrix_add_grad = _lazy_op('matrix_add_grad')
+matrix_add_n = _lazy_op('matrix_add_n')
+matrix_add_n_grad = _lazy_op('matrix_add_n_grad')
+matrix_add_grouped = _lazy_op('matrix_add_grouped')
+matrix_add_sparse_grad = _lazy_op('matrix_add_sparse_grad')
+matrix_add_v2 = _lazy_op('matrix_add_v2')
+matrix_add_v2_grad = _lazy_op('matrix_add_v2_grad')
+quantized_matrix_add = _lazy_op('quantized_matrix_add')
+
+# ops stamped out by "add_tf_elementwise_operation" (see CMakeLists.txt)
+matrix_sub = _lazy_op('matrix_sub')
+matrix_mul = _lazy_op('matrix_mul')
+matrix_minimum = _lazy_op('matrix_minimum')
+matrix_maximum = _lazy_op('matrix_maximum')
+
+
+def matrix_add_host_a(matrix_a, matrix_b, bias, **kwargs):
+    """Same as `matrix_add` on the GPU, but `matrix_a` stays in host memory.
+
+    Instead of a synchronous copy in front of the op, `matrix_a` is copied to
+    the GPU in chunks which overlap with the computation. Both inputs must
+    have the same shape.
+    """
+    with tf.get_default_graph()._kernel_label_map({'MatrixAdd': 'host_a'}):
+        return matrix_add(matrix_a, matrix_b, bias, **kwargs)
+
+
+def matrix_add_optimizer_config(config=None):
+    """Enables the Grappler pass "MatrixAddFusion" in a session config.
 
-__all__ = ['matrix_add', 'matrix_add_grad']
+    The pass rewrites chains of `matrix_add` (and a trailing `tf.nn.relu`) into
+    `matrix_add_n` and the fused activation, e.g. of an imported SavedModel.
+    """
+    # the pass is registered by the library
+    load_library()
+    if config is None:
+        config = tf.ConfigProto()
+    config.graph_options.rewrite_options.custom_optimizers.add(name='MatrixAddFusion')
+    return config
 
-path = os.path.join(os.path.dirname(__file__), 'matrix_add_op.so')
-_matrix_add_module = tf.load_op_library(path)
 
-matrix_add = _matrix_add_module.matrix_add
-matrix_add_grad = _matrix_add_module.matrix_add_grad
+def _same_static_shape(*tensors):
+    # gradients of broadcasted inputs need a reduction, which is dense
+    shapes = [t.get_shape() for t in tensors]
+    return (all(s.is_fully_defined() for s in shapes) and
+            all(s == shapes[0] for s in shapes))
 
 
 @ops.RegisterGradient("MatrixAdd")
 def _MatrixAddGrad(op, *grads):
     bias = op.get_attr('bias')
+    activation = op.get_attr('activation')
+    alpha = op.get_attr('alpha')
+    scale = op.get_attr('scale')
     matA = op.inputs[0]
     matB = op.inputs[1]
-    # top = op.outputs[0]
+    top = op.outputs[0]
     topdiff = grads[0]
-    return _matrix_add_module.matrix_add_grad(matA, matB, topdiff, bias=bias)
+    if isinstance(topdiff, ops.IndexedSlices) and _same_static_shape(matA, matB, top):
+        # e.g. behind a "tf.gather", only the sliced rows carry a gradient and
+        # the IndexedSlices are passed on instead of densifying them
+        values = topdiff.values
+        if activation != 'none' or scale != 1:
+            values = matrix_add_sparse_grad(
+                values, topdiff.indices, matA, matB, top, bias=bias,
+                activation=activation, alpha=alpha, scale=scale)
+        grad = ops.IndexedSlices(values, topdiff.indices, topdiff.dense_shape)
+        return grad, grad
+    return matrix_add_grad(matA, matB, topdiff, top, bias=bias,
+                           activation=activation, alpha=alpha, scale=scale)
+
+
+@ops.RegisterGradient("MatrixAddV2")
+def _MatrixAddV2Grad(op, *grads):
+    matA, matB, bias = op.inputs
+    return matrix_add_v2_grad(matA, matB, bias, grads[0], op.outputs[0],
+                              activation=op.get_attr('activation'),
+                              alpha=op.get_attr('alpha'),
+                              scale=op.get_attr('scale'))
+
+
+@ops.RegisterGradient("MatrixAddN")
+def _MatrixAddNGrad(op, *grads):
+    topdiff = grads[0]
+    return matrix_add_n_grad(topdiff, N=len(op.inputs))
+
+
+@ops.RegisterGradient("MatrixAddGrouped")
+def _MatrixAddGroupedGrad(op, *grads):
+    # the gradient of both inputs of group k is just the k-th gradient
+    return list(grads) + list(grads)
+
+
+def _activation_grad(op, grad, fn):
+    # gradient w.r.t. the input "x" of the fused activation, "y" is the output
+    activation = op.get_attr('activation')
+    alpha = op.get_attr('alpha')
+    y = op.outputs[0]
+    if activation == 'relu':
+        return tf.where(y > 0, grad, tf.zeros_like(grad))
+    if activation == 'leaky_relu':
+        return tf.where(y > 0, grad, grad * alpha)
+    if activation == 'gelu':
+        x = fn(op.inputs[0], op.inputs[1], bias=op.get_attr('bias'),
+               scale=op.get_attr('scale'))
+        t = tf.tanh(0.7978845608028654 * (x + 0.044715 * x * x * x))
+        dinner = 0.7978845608028654 * (1 + 3 * 0.044715 * x * x)
+        return grad * (0.5 * (1 + t) + 0.5 * x * (1 - t * t) * dinner)
+    return grad
+
+
+def _elementwise_grad(fn, grad_a, grad_b):
+    # gradient of the stamped out op "fn" given the partial derivatives
+    # "grad_a(a, b, g)" and "grad_b(a, b, g)" of "Op(a, b)"
+    def _grad(op, grad):
+        matA, matB = op.inputs
+        grad = _activation_grad(op, grad, fn)
+        if op.get_attr('scale') != 1:
+            grad = grad * tf.cast(op.get_attr('scale'), grad.dtype)
+        shape_a, shape_b = tf.shape(matA), tf.shape(matB)
+        # sum over the broadcasted axes of each input
+        reduce_a, reduce_b = gen_array_ops.broadcast_gradient_args(shape_a, shape_b)
+        return (tf.reshape(tf.reduce_sum(grad_a(matA, matB, grad), reduce_a), shape_a),
+                tf.reshape(tf.reduce_sum(grad_b(matA, matB, grad), reduce_b), shape_b))
+    return _grad
+
+
+def _mask(cond, grad):
+    return grad * tf.cast(cond, grad.dtype)
+
+
+_ELEMENTWISE_GRADS = {
+    'MatrixSub': (matrix_sub, lambda a, b, g: g, lambda a, b, g: -g),
+    'MatrixMul': (matrix_mul, lambda a, b, g: g * b, lambda a, b, g: g * a),
+    'MatrixMinimum': (matrix_minimum, lambda a, b, g: _mask(a <= b, g), lambda a, b, g: _mask(a > b, g)),
+    'MatrixMaximum': (matrix_maximum, lambda a, b, g: _mask(a >= b, g), lambda a, b, g: _mask(a < b, g)),
+}
+
+for _name, (_fn, _grad_a, _grad_b) in _ELEMENTWISE_GRADS.items():
+    ops.RegisterGradient(_name)(_elementwise_grad(_fn, _grad_a, _grad_b))
+
+ops.NotDifferentiable("QuantizedMatrixAdd")
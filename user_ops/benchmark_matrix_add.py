@@ -0,0 +1,282 @@
+#!/usr/bin/env python
+# ComputerGraphics Tuebingen, 2018
+
+"""Benchmarks of the MatrixAdd kernels.
+
+Run all benchmarks with
+
+    python benchmark_matrix_add.py --benchmarks=.
+
+or a subset by passing a regex like `--benchmarks=benchmark_forward`. The peak
+bandwidth of the devices (in GB/s) can be given by the environment variables
+`MATRIX_ADD_PEAK_GBPS_CPU` and `MATRIX_ADD_PEAK_GBPS_GPU`, the achieved
+bandwidth is then reported as a fraction of it.
+
+On multi-socket hosts `benchmark_forward_per_node` runs the CPU forward pass
+restricted to the CPUs (and hence the memory) of each NUMA node in turn.
+
+`benchmark_forward_streams` shows the scaling of the GPU forward pass over
+the number of streams (`MATRIX_ADD_GPU_STREAMS`) for large outputs.
+
+`benchmark_roofline` measures the bandwidth of each kernel variant against
+a STREAM-style copy (`tf.assign`) on the same device and writes a JSON
+report to `MATRIX_ADD_ROOFLINE_REPORT` (default `matrix_add_roofline.json`).
+"""
+
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+import numpy as np
+import tensorflow as tf
+from __init__ import matrix_add, matrix_add_grad, matrix_add_n
+
+# from a few bytes up to 1 GiB per float32 tensor
+SHAPES = [(1, 2, 3, 4),
+          (1, 32, 32, 16),
+          (8, 64, 64, 32),
+          (32, 128, 128, 64),
+          (64, 256, 256, 64)]
+
+DTYPES = [tf.float16, tf.float32, tf.float64, tf.int32]
+
+MAX_BYTES = 1 << 30
+
+# inputs of the fused N-ary kernel in the roofline
+NUM_INPUTS = 4
+
+# kernel variants of the roofline, each one is measured in a process of its
+# own as the settings are read once per process
+ROOFLINE_VARIANTS = [
+    ('cpu', 'simd', {'MATRIX_ADD_NONTEMPORAL_BYTES': '-1'}),
+    # the generic loops are still vectorized by the compiler, with SSE2 (the
+    # baseline of x86-64)
+    ('cpu', 'sse2_generic', {'MATRIX_ADD_NONTEMPORAL_BYTES': '-1',
+                             'MATRIX_ADD_CPU_ISA': 'generic'}),
+    ('cpu', 'streaming', {'MATRIX_ADD_NONTEMPORAL_BYTES': '0'}),
+    ('gpu', 'vectorized', {'MATRIX_ADD_USE_AUTOTUNE': '0'}),
+    ('gpu', 'scalar', {'MATRIX_ADD_USE_AUTOTUNE': '0', 'MATRIX_ADD_VECTORIZED': '0'}),
+]
+
+
+def _devices():
+    devices = [('cpu', '/cpu:0')]
+    if tf.test.is_gpu_available(cuda_only=True):
+        devices.append(('gpu', '/gpu:0'))
+    return devices
+
+
+def _peak_gbps(device):
+    peak = os.environ.get('MATRIX_ADD_PEAK_GBPS_%s' % device.upper())
+    return float(peak) if peak else None
+
+
+def _numa_nodes():
+    """Returns {node: set of cpus} as reported by sysfs (empty if unknown)."""
+    def parse(cpulist):
+        cpus = set()
+        for part in cpulist.strip().split(','):
+            if part:
+                first, _, last = part.partition('-')
+                cpus.update(range(int(first), int(last or first) + 1))
+        return cpus
+
+    nodes = {}
+    root = '/sys/devices/system/node'
+    if os.path.isdir(root):
+        for name in sorted(os.listdir(root)):
+            if name.startswith('node') and name[4:].isdigit():
+                with open(os.path.join(root, name, 'cpulist')) as f:
+                    cpus = parse(f.read())
+                if cpus:
+                    nodes[int(name[4:])] = cpus
+    return nodes
+
+
+def _random(shape, dtype):
+    # values are irrelevant, they just have to live on the device
+    return tf.Variable(tf.cast(tf.random_uniform(shape, -10, 10), dtype), trainable=False)
+
+
+class MatrixAddBenchmark(tf.test.Benchmark):
+
+    def _run(self, name, device, device_str, shape, dtype, build_fn, bytes_per_run, extras=None):
+        nbytes = np.prod(shape) * dtype.size
+        if nbytes > MAX_BYTES:
+            return
+
+        with tf.Graph().as_default(), tf.device(device_str):
+            op = tf.group(build_fn(shape, dtype))
+
+            with tf.Session() as sess:
+                sess.run(tf.global_variables_initializer())
+
+                name = '%s_%s_%s_%s' % (name, device, dtype.name, 'x'.join(map(str, shape)))
+                result = self.run_op_benchmark(sess, op, burn_iters=3, min_iters=10,
+                                               name=name, store_memory_usage=False)
+
+        gbps = bytes_per_run * nbytes / result['wall_time'] / 1e9
+        extras = dict(extras or {}, gbps=gbps, bytes=int(bytes_per_run * nbytes))
+
+        peak = _peak_gbps(device)
+        if peak:
+            extras['peak_gbps'] = peak
+            extras['fraction_of_peak'] = gbps / peak
+
+        self.report_benchmark(name=name, iters=result['iters'],
+                              wall_time=result['wall_time'], extras=extras)
+        return dict(extras, wall_time=result['wall_time'])
+
+    def _sweep(self, name, build_fn, bytes_per_run, dtypes=DTYPES):
+        for device, device_str in _devices():
+            for dtype in dtypes:
+                for shape in SHAPES:
+                    self._run(name, device, device_str, shape, dtype, build_fn, bytes_per_run)
+
+    def benchmark_forward(self):
+        def build(shape, dtype):
+            return matrix_add(_random(shape, dtype), _random(shape, dtype), 1.)
+
+        # reads A and B, writes C
+        self._sweep('forward', build, 3)
+
+    def benchmark_forward_broadcast(self):
+        def build(shape, dtype):
+            return matrix_add(_random(shape, dtype), _random((1, 1, 1, shape[3]), dtype), 1.)
+
+        # reads A, writes C (the per-channel term stays in cache)
+        self._sweep('forward_broadcast', build, 2)
+
+    def benchmark_forward_per_node(self):
+        nodes = _numa_nodes()
+        if len(nodes) < 2 or not hasattr(os, 'sched_setaffinity'):
+            return
+
+        # the intra-op thread pool is created once per process and inherits
+        # the affinity of its creator, hence one process per node
+        for node, cpus in sorted(nodes.items()):
+            env = dict(os.environ, MATRIX_ADD_BENCHMARK_NODE=str(node))
+            subprocess.check_call([sys.executable, os.path.abspath(__file__),
+                                   '--benchmarks=benchmark_forward_local_node'],
+                                  env=env, preexec_fn=lambda cpus=cpus: os.sched_setaffinity(0, cpus))
+
+    def benchmark_forward_local_node(self):
+        node = os.environ.get('MATRIX_ADD_BENCHMARK_NODE')
+        if node is None:
+            return
+
+        def build(shape, dtype):
+            return matrix_add(_random(shape, dtype), _random(shape, dtype), 1.)
+
+        # all memory is first touched by threads of this node
+        for shape in SHAPES[-2:]:
+            self._run('forward_node%s' % node, 'cpu', '/cpu:0', shape, tf.float32,
+                      build, 3, extras={'node': int(node)})
+
+    def benchmark_forward_streams(self):
+        if 'gpu' not in dict(_devices()) or os.environ.get('MATRIX_ADD_BENCHMARK_STREAMS'):
+            return
+
+        # the number of streams is read once per process
+        for streams in [1, 2, 4, 8]:
+            env = dict(os.environ, MATRIX_ADD_BENCHMARK_STREAMS=str(streams),
+                       MATRIX_ADD_GPU_STREAMS=str(streams), MATRIX_ADD_GPU_STREAM_MIN_BYTES='0')
+            subprocess.check_call([sys.executable, os.path.abspath(__file__),
+                                   '--benchmarks=benchmark_forward_on_streams'], env=env)
+
+    def benchmark_forward_on_streams(self):
+        streams = os.environ.get('MATRIX_ADD_BENCHMARK_STREAMS')
+        if streams is None:
+            return
+
+        def build(shape, dtype):
+            return matrix_add(_random(shape, dtype), _random(shape, dtype), 1.)
+
+        for shape in SHAPES[-2:]:
+            self._run('forward_streams%s' % streams, 'gpu', '/gpu:0', shape, tf.float32,
+                      build, 3, extras={'streams': int(streams)})
+
+    def benchmark_backward_copy(self):
+        def build(shape, dtype):
+            matA = _random(shape, dtype)
+            matB = _random(shape, dtype)
+            topdiff = _random(shape, dtype)
+            return matrix_add_grad(matA, matB, topdiff, topdiff, bias=1., copy_gradients=True)
+
+        # reads the gradient once, writes both outputs
+        self._sweep('backward_copy', build, 3, [dt for dt in DTYPES if dt.is_floating])
+
+    def benchmark_roofline(self):
+        if os.environ.get('MATRIX_ADD_ROOFLINE_PART'):
+            return
+
+        devices = dict(_devices())
+        results = []
+        for device, variant, env in ROOFLINE_VARIANTS:
+            if device not in devices:
+                continue
+            with tempfile.NamedTemporaryFile(suffix='.json') as part:
+                env = dict(os.environ, MATRIX_ADD_ROOFLINE_PART=part.name,
+                           MATRIX_ADD_ROOFLINE_DEVICE=device,
+                           MATRIX_ADD_ROOFLINE_VARIANT=variant, **env)
+                subprocess.check_call([sys.executable, os.path.abspath(__file__),
+                                       '--benchmarks=benchmark_roofline_variant'], env=env)
+                with open(part.name) as f:
+                    results.extend(json.load(f))
+
+        # the copy is measured by every process, the best one is the baseline
+        baseline = {}
+        for r in results:
+            if r['kernel'] == 'copy':
+                key = (r['device'], r['dtype'], tuple(r['shape']))
+                baseline[key] = max(baseline.get(key, 0.), r['gbps'])
+        for r in results:
+            copy_gbps = baseline.get((r['device'], r['dtype'], tuple(r['shape'])))
+            if copy_gbps:
+                r['copy_gbps'] = copy_gbps
+                r['fraction_of_copy'] = r['gbps'] / copy_gbps
+
+        report = {'devices': {device: {'peak_gbps': _peak_gbps(device)} for device in devices},
+                  'results': results}
+        path = os.environ.get('MATRIX_ADD_ROOFLINE_REPORT', 'matrix_add_roofline.json')
+        with open(path, 'w') as f:
+            json.dump(report, f, indent=2, sort_keys=True)
+
+    def benchmark_roofline_variant(self):
+        part = os.environ.get('MATRIX_ADD_ROOFLINE_PART')
+        if part is None:
+            return
+        device = os.environ['MATRIX_ADD_ROOFLINE_DEVICE']
+        variant = os.environ['MATRIX_ADD_ROOFLINE_VARIANT']
+        device_str = dict(_devices())[device]
+
+        def copy(shape, dtype):
+            return tf.assign(_random(shape, dtype), _random(shape, dtype))
+
+        def forward(shape, dtype):
+            return matrix_add(_random(shape, dtype), _random(shape, dtype), 1.)
+
+        def forward_n(shape, dtype):
+            return matrix_add_n([_random(shape, dtype) for _ in range(NUM_INPUTS)], 1.)
+
+        # bytes moved per element: the copy reads and writes once, the
+        # kernels read all inputs and write the output
+        kernels = [('copy', copy, 2), ('forward', forward, 3),
+                   ('forward_n', forward_n, NUM_INPUTS + 1)]
+
+        results = []
+        for kernel, build, bytes_per_run in kernels:
+            for shape in SHAPES[2:4]:
+                r = self._run('roofline_%s_%s' % (kernel, variant), device, device_str,
+                              shape, tf.float32, build, bytes_per_run)
+                if r:
+                    results.append(dict(r, kernel=kernel, variant=variant, device=device,
+                                        dtype='float32', shape=list(shape)))
+        with open(part, 'w') as f:
+            json.dump(results, f)
+
+
+if __name__ == '__main__':
+    tf.test.main()
@@ -0,0 +1,89 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_H_
+#define MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_H_
+
+#include "matrix_add_op.h"
+
+namespace tensorflow {
+namespace functor {
+
+// Binary operations of the elementwise engine, which computes
+//
+//   C = activation(scale * Op::apply(A, B) + bias)
+//
+// in the accumulator type of the inputs, with numpy-style broadcasting and
+// the fused epilogue of "MatrixAdd". "MatrixAdd" itself runs on the engine
+// with "BinaryAdd". Further ops are stamped out from a one-line definition
+// in CMakeLists.txt (see "add_tf_elementwise_operation").
+//
+// "cost" is the cost of one "apply" on the CPU (in the units of
+// "Eigen::TensorOpCost"), which decides on the size of the shards.
+struct BinaryAdd {
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T a, T b) { return a + b; }
+
+  template <typename T>
+  static double cost() { return Eigen::TensorOpCost::AddCost<T>(); }
+};
+
+struct BinarySub {
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T a, T b) { return a - b; }
+
+  template <typename T>
+  static double cost() { return Eigen::TensorOpCost::AddCost<T>(); }
+};
+
+struct BinaryMul {
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T a, T b) { return a * b; }
+
+  template <typename T>
+  static double cost() { return Eigen::TensorOpCost::MulCost<T>(); }
+};
+
+struct BinaryMinimum {
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T a, T b) { return a < b ? a : b; }
+
+  template <typename T>
+  static double cost() { return Eigen::TensorOpCost::AddCost<T>(); }
+};
+
+struct BinaryMaximum {
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T a, T b) { return a < b ? b : a; }
+
+  template <typename T>
+  static double cost() { return Eigen::TensorOpCost::AddCost<T>(); }
+};
+
+// "mA_" and "mB_" have the same number of elements
+template <typename Device, typename Op, typename Dtype>
+struct ElementwiseBinaryFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue);
+};
+
+// "index_a" and "index_b" map the flat index of "mC_" into the inputs
+template <typename Device, typename Op, typename Dtype>
+struct ElementwiseBinaryBroadcastFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b);
+};
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_H_
@@ -0,0 +1,124 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_CPU_H_
+#define MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_CPU_H_
+
+// requires EIGEN_USE_THREADS (defined by the including translation unit)
+
+#include <algorithm>
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "elementwise_binary.h"
+
+namespace tensorflow {
+namespace functor {
+
+// Shards of the CPU engine, instantiated for every activation "A" and
+// selected at runtime by "DispatchActivation".
+template <typename Op>
+struct ElementwiseBinaryShard {
+  // c = activation(scale * Op(a, b) + bias) for one shard of contiguous memory, the
+  // loop has no dependencies and is vectorized by the compiler
+  template <Activation A>
+  struct Flat {
+    template <typename Dtype>
+    static void Run(const Dtype* a, const Dtype* b, Dtype* c,
+                    int64 size, Dtype bias, float scale, float alpha) {
+      typedef typename AccumulatorType<Dtype>::type Acc;
+      const Acc bias_ = Acc(bias);
+      for (int64 i = 0; i < size; ++i)
+        c[i] = static_cast<Dtype>(ActivationFn<A>::apply(
+                 ApplyScale(Op::apply(Acc(a[i]), Acc(b[i])), scale) + bias_, alpha));
+    }
+  };
+
+  // same as "Flat" for broadcasted inputs, the shard [start, end) is given
+  // in terms of the flat output index
+  template <Activation A>
+  struct Broadcast {
+    template <typename Dtype>
+    static void Run(const Dtype* mA, const Dtype* mB, Dtype* mC,
+                    int64 start, int64 end, Dtype bias, float scale, float alpha,
+                    const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+      typedef typename AccumulatorType<Dtype>::type Acc;
+      const Acc bias_ = Acc(bias);
+
+      // the index arithmetic is only done once per row of the inner-most axis
+      const int inner = index_a.ndims - 1;
+      const int64 row = index_a.dims[inner];
+      const int64 stride_a = index_a.strides[inner];
+      const int64 stride_b = index_b.strides[inner];
+
+      for (int64 i = start; i < end;) {
+        int64 a = index_a(i);
+        int64 b = index_b(i);
+        const int64 row_end = std::min<int64>(end, (i / row + 1) * row);
+        for (; i < row_end; ++i, a += stride_a, b += stride_b)
+          mC[i] = static_cast<Dtype>(ActivationFn<A>::apply(
+                    ApplyScale(Op::apply(Acc(mA[a]), Acc(mB[b])), scale) + bias_, alpha));
+      }
+    }
+  };
+
+  // per element: two loads, one store, "Op", the scale and the bias
+  template <typename Dtype>
+  static Eigen::TensorOpCost Cost() {
+    return Eigen::TensorOpCost(2 * sizeof(Dtype), sizeof(Dtype),
+                               Op::template cost<Dtype>() +
+                               Eigen::TensorOpCost::MulCost<Dtype>() +
+                               Eigen::TensorOpCost::AddCost<Dtype>());
+  }
+};
+
+template <typename Op, typename Dtype>
+struct ElementwiseBinaryFunctor<CPUDevice, Op, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue) {
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mA_.NumElements();
+
+    typedef ElementwiseBinaryShard<Op> Shard;
+    ctx->eigen_device<CPUDevice>().parallelFor(N, Shard::template Cost<Dtype>(),
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<Shard::template Flat>(epilogue.activation,
+          mA + start, mB + start, mC + start, end - start, bias,
+          epilogue.scale, epilogue.alpha);
+    });
+  }
+};
+
+template <typename Op, typename Dtype>
+struct ElementwiseBinaryBroadcastFunctor<CPUDevice, Op, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mC_->NumElements();
+
+    typedef ElementwiseBinaryShard<Op> Shard;
+    ctx->eigen_device<CPUDevice>().parallelFor(N, Shard::template Cost<Dtype>(),
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<Shard::template Broadcast>(epilogue.activation,
+          mA, mB, mC, start, end, bias, epilogue.scale, epilogue.alpha, index_a, index_b);
+    });
+  }
+};
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_CPU_H_
@@ -0,0 +1,314 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_GPU_CU_H_
+#define MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_GPU_CU_H_
+
+#if GOOGLE_CUDA
+
+// requires EIGEN_USE_GPU (defined by the including translation unit)
+
+#include <algorithm>
+#include <cstdint>
+
+#include <cuda_fp16.h>
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/util/cuda_kernel_helper.h"
+#include "elementwise_binary.h"
+#include "matrix_add_autotune.h"
+#include "matrix_add_trace.h"
+
+namespace tensorflow {
+namespace functor {
+namespace elementwise {
+
+// 128-bit vector types, the widest loads/stores a thread can issue
+template<typename T>
+struct Vec128;
+
+template<> struct Vec128<float>  { typedef float4  type; };
+template<> struct Vec128<int>    { typedef int4    type; };
+template<> struct Vec128<double> { typedef double2 type; };
+template<> struct Vec128<Eigen::half> { typedef float4 type; };
+template<> struct Vec128<::tensorflow::bfloat16> { typedef float4 type; };
+
+template<typename T>
+struct Vectorized {
+  typedef typename Vec128<T>::type type;
+  static constexpr int size = sizeof(type) / sizeof(T);
+
+  static bool aligned(const void* ptr) {
+    return reinterpret_cast<uintptr_t>(ptr) % sizeof(type) == 0;
+  }
+};
+
+
+// Loads through the read-only data cache. The kernels are built for every
+// architecture of MATRIX_ADD_CUDA_ARCHS and "__CUDA_ARCH__" is the one of
+// the binary the driver picks at runtime (there is no "__ldg" for the
+// 16-bit types, their vectorized paths load "float4" instead).
+template<typename T>
+__device__ __forceinline__ T LoadReadOnly(const T* ptr) {
+#if __CUDA_ARCH__ >= 350
+  return __ldg(ptr);
+#else
+  return *ptr;
+#endif
+}
+
+template<>
+__device__ __forceinline__ Eigen::half LoadReadOnly(const Eigen::half* ptr) {
+  return *ptr;
+}
+
+template<>
+__device__ __forceinline__ ::tensorflow::bfloat16 LoadReadOnly(const ::tensorflow::bfloat16* ptr) {
+  return *ptr;
+}
+
+
+// launch configuration for grid-stride loops over "work" items
+//
+// In contrast to "GetCudaLaunchConfig" we do not launch one thread per item.
+// The grid is sized to exactly fill the device (as many resident blocks as
+// every multiprocessor of this architecture can hold) and each thread
+// strides over several items. This gives longer-running threads with more
+// loads in flight, which is what a bandwidth-bound kernel needs.
+struct LaunchConfig {
+  int block_count;
+  int thread_per_block;
+};
+
+inline LaunchConfig GetLaunchConfig(const int work, const ::tensorflow::GPUDevice& d,
+                                    const int thread_per_block = 256) {
+  LaunchConfig cfg;
+  cfg.thread_per_block = std::min(thread_per_block, d.maxCudaThreadsPerBlock());
+
+  const int resident_blocks = d.getNumCudaMultiProcessors() *
+      (d.maxCudaThreadsPerMultiProcessor() / cfg.thread_per_block);
+  const int needed_blocks = (work + cfg.thread_per_block - 1) / cfg.thread_per_block;
+  cfg.block_count = std::max(1, std::min(resident_blocks, needed_blocks));
+  return cfg;
+}
+
+
+// activation(scale * Op(a, b) + bias), computed in the accumulator type of "T"
+template<typename Op, Activation A, typename T>
+__device__ __forceinline__ T BinaryActivate(const T a, const T b, const T bias,
+                                            const float scale, const float alpha) {
+  typedef typename AccumulatorType<T>::type Acc;
+  const Acc x = ApplyScale(Op::apply(Acc(a), Acc(b)), scale) + Acc(bias);
+  return static_cast<T>(ActivationFn<A>::apply(x, alpha));
+}
+
+// "BinaryActivate" for all lanes of a 128-bit vector
+template<typename Op, Activation A, typename T>
+struct BinaryActivateVectorized {
+  typedef typename Vectorized<T>::type V;
+
+  __device__ __forceinline__ static V Run(const V& a, const V& b, const T bias,
+                                          const float scale, const float alpha) {
+    V c;
+    const T* a_ = reinterpret_cast<const T*>(&a);
+    const T* b_ = reinterpret_cast<const T*>(&b);
+    T* c_ = reinterpret_cast<T*>(&c);
+#pragma unroll
+    for (int k = 0; k < Vectorized<T>::size; ++k)
+      c_[k] = BinaryActivate<Op, A>(a_[k], b_[k], bias, scale, alpha);
+    return c;
+  }
+};
+
+// half precision is processed as "half2" pairs, which are converted to
+// "float2" with a single instruction and rounded back together
+template<typename Op, Activation A>
+struct BinaryActivateVectorized<Op, A, Eigen::half> {
+  typedef typename Vectorized<Eigen::half>::type V;
+
+  __device__ __forceinline__ static V Run(const V& a, const V& b, const Eigen::half bias,
+                                          const float scale, const float alpha) {
+    V c;
+    const __half2* a2 = reinterpret_cast<const __half2*>(&a);
+    const __half2* b2 = reinterpret_cast<const __half2*>(&b);
+    __half2* c2 = reinterpret_cast<__half2*>(&c);
+    const float bias_ = static_cast<float>(bias);
+#pragma unroll
+    for (int k = 0; k < static_cast<int>(sizeof(V) / sizeof(__half2)); ++k) {
+      const float2 a_ = __half22float2(a2[k]);
+      const float2 b_ = __half22float2(b2[k]);
+      const float x = scale * Op::apply(a_.x, b_.x) + bias_;
+      const float y = scale * Op::apply(a_.y, b_.y) + bias_;
+      c2[k] = __floats2half2_rn(ActivationFn<A>::apply(x, alpha), ActivationFn<A>::apply(y, alpha));
+    }
+    return c;
+  }
+};
+
+
+// the kernels below are instantiated for every activation "A" and
+// selected at runtime by "DispatchActivation"
+template<typename Op, typename T, Activation A>
+__global__ void forward(T* top,
+                        const int N,
+                        const T* matrixA,
+                        const T* matrixB,
+                        const T bias,
+                        const float scale,
+                        const float alpha) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    top[i] = BinaryActivate<Op, A>(LoadReadOnly(matrixA + i), LoadReadOnly(matrixB + i),
+                                   bias, scale, alpha);
+  }
+}
+
+
+// same as "forward" but with 128-bit loads and stores,
+// requires all buffers to be aligned to 16 bytes
+template<typename Op, typename T, Activation A>
+__global__ void forward_vectorized(T* top,
+                                   const int N,
+                                   const T* matrixA,
+                                   const T* matrixB,
+                                   const T bias,
+                                   const float scale,
+                                   const float alpha) {
+  typedef typename Vectorized<T>::type V;
+  constexpr int kSize = Vectorized<T>::size;
+
+  const int N_vec = N / kSize;
+  const V* matrixA_vec = reinterpret_cast<const V*>(matrixA);
+  const V* matrixB_vec = reinterpret_cast<const V*>(matrixB);
+  V* top_vec = reinterpret_cast<V*>(top);
+
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N_vec; i += blockDim.x * gridDim.x) {
+    top_vec[i] = BinaryActivateVectorized<Op, A, T>::Run(LoadReadOnly(matrixA_vec + i),
+                                                         LoadReadOnly(matrixB_vec + i),
+                                                         bias, scale, alpha);
+  }
+
+  // scalar tail (less than "kSize" elements)
+  const int i = N_vec * kSize + blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N)
+    top[i] = BinaryActivate<Op, A>(LoadReadOnly(matrixA + i), LoadReadOnly(matrixB + i),
+                                   bias, scale, alpha);
+}
+
+
+template<typename Op, typename T, Activation A>
+__global__ void forward_broadcast(T* top,
+                                  const int N,
+                                  const T* matrixA,
+                                  const T* matrixB,
+                                  const T bias,
+                                  const float scale,
+                                  const float alpha,
+                                  const BroadcastIndex index_a,
+                                  const BroadcastIndex index_b) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    top[i] = BinaryActivate<Op, A>(LoadReadOnly(matrixA + index_a(i)),
+                                   LoadReadOnly(matrixB + index_b(i)), bias, scale, alpha);
+  }
+}
+
+
+// launchers, "stream" is the stream of the op ("d.stream()") or a side
+// stream of a chunked launch
+template<typename Op>
+struct Launch {
+  template<Activation A>
+  struct Forward {
+    template<typename T>
+    static void Run(const ::tensorflow::GPUDevice& d, cudaStream_t stream,
+                    const int thread_per_block, const bool vectorized, T* top, const int N,
+                    const T* matrixA, const T* matrixB, const T bias,
+                    const float scale, const float alpha) {
+      if (vectorized) {
+        MATRIX_ADD_NVTX_RANGE("forward_vectorized");
+        LaunchConfig cfg = GetLaunchConfig(N / Vectorized<T>::size, d, thread_per_block);
+        forward_vectorized<Op, T, A>
+        <<< cfg.block_count, cfg.thread_per_block, 0, stream >>> (
+          top, N, matrixA, matrixB, bias, scale, alpha);
+      } else {
+        MATRIX_ADD_NVTX_RANGE("forward");
+        LaunchConfig cfg = GetLaunchConfig(N, d, thread_per_block);
+        forward<Op, T, A>
+        <<< cfg.block_count, cfg.thread_per_block, 0, stream >>> (
+          top, N, matrixA, matrixB, bias, scale, alpha);
+      }
+    }
+  };
+
+  template<Activation A>
+  struct ForwardBroadcast {
+    template<typename T>
+    static void Run(const ::tensorflow::GPUDevice& d, T* top, const int N,
+                    const T* matrixA, const T* matrixB, const T bias,
+                    const float scale, const float alpha,
+                    const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+      MATRIX_ADD_NVTX_RANGE("forward_broadcast");
+      LaunchConfig cfg = GetLaunchConfig(N, d);
+      forward_broadcast<Op, T, A>
+      <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+        top, N, matrixA, matrixB, bias, scale, alpha, index_a, index_b);
+    }
+  };
+};
+
+}  // namespace elementwise
+
+
+// The stamped out ops use the default launch parameters, the autotuning and
+// the side streams of "MatrixAddFunctor" are specific to "MatrixAdd".
+template <typename Op, typename Dtype>
+struct ElementwiseBinaryFunctor<GPUDevice, Op, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue) {
+    const int N = mA_.NumElements();
+    if (N == 0)
+      return;
+
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+
+    typedef elementwise::Vectorized<Dtype> V;
+    const bool aligned = ForwardAutotuneMap::Global()->vectorize() &&
+                         V::aligned(mA) && V::aligned(mB) && V::aligned(mC);
+    DispatchActivation<elementwise::Launch<Op>::template Forward>(epilogue.activation,
+        d, d.stream(), 256, aligned, mC, N, mA, mB, bias, epilogue.scale, epilogue.alpha);
+  }
+};
+
+template <typename Op, typename Dtype>
+struct ElementwiseBinaryBroadcastFunctor<GPUDevice, Op, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const int N = mC_->NumElements();
+    if (N == 0)
+      return;
+
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    DispatchActivation<elementwise::Launch<Op>::template ForwardBroadcast>(epilogue.activation,
+        d, mC_->flat<Dtype>().data(), N,
+        mA_.flat<Dtype>().data(), mB_.flat<Dtype>().data(), bias, epilogue.scale, epilogue.alpha,
+        index_a, index_b);
+  }
+};
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // GOOGLE_CUDA
+
+#endif  // MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_GPU_CU_H_
@@ -0,0 +1,145 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_OP_H_
+#define MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_OP_H_
+
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/util/bcast.h"
+
+#include "elementwise_binary.h"
+#include "matrix_add_trace.h"
+
+namespace tensorflow {
+namespace functor {
+
+// Index into an input of (collapsed) shape "input_dims" given the flat
+// index of the output of shape "output_dims" (both as computed by BCast).
+inline BroadcastIndex MakeBroadcastIndex(const BCast::Vec& input_dims,
+                                         const BCast::Vec& output_dims) {
+  BroadcastIndex index;
+  index.ndims = output_dims.size();
+
+  int64 stride = 1;
+  for (int k = index.ndims - 1; k >= 0; --k) {
+    index.dims[k] = output_dims[k];
+    index.strides[k] = (input_dims[k] == 1) ? 0 : stride;
+    stride *= input_dims[k];
+  }
+  return index;
+}
+
+inline Status CheckBroadcast(const BCast& bcast, const Tensor& mA, const Tensor& mB) {
+  if (!bcast.IsValid())
+    return errors::InvalidArgument("Incompatible shapes: ",
+                                   mA.shape().DebugString(), " vs. ",
+                                   mB.shape().DebugString());
+  if (bcast.result_shape().size() > BroadcastIndex::kMaxDims)
+    return errors::Unimplemented("Broadcasting over more than ",
+                                 static_cast<int>(BroadcastIndex::kMaxDims), " axes");
+  return Status::OK();
+}
+
+// How the output of an elementwise binary op is computed from its inputs.
+struct BinaryBroadcast {
+  // nothing is broadcasted (e.g. [M, N] + [1, M, N]), which collapses all
+  // axes into a single flat one
+  bool flat;
+  // otherwise the index into "matrix_a" and "matrix_b" given the flat index
+  // of the output
+  BroadcastIndex index_a;
+  BroadcastIndex index_b;
+};
+
+// Broadcasts the inputs 0 and 1 numpy-style, e.g. [B, M, N, D] + [1, 1, 1,
+// D], with any rank. BCast merges adjacent axes which are broadcasted the
+// same way, so this is handled as [B*M*N, D] + [1, D]. Output 0 is written
+// into the buffer of either input if no other op needs it anymore,
+// otherwise it is allocated.
+inline Status PrepareBinaryOp(OpKernelContext* ctx, BinaryBroadcast* broadcast, Tensor** mC) {
+  const Tensor& mA = ctx->input(0);
+  const Tensor& mB = ctx->input(1);
+
+  BCast bcast(BCast::FromShape(mA.shape()), BCast::FromShape(mB.shape()));
+  TF_RETURN_IF_ERROR(CheckBroadcast(bcast, mA, mB));
+
+  const TensorShape output_shape = BCast::ToShape(bcast.output_shape());
+  // equal sizes of the inputs are not enough, e.g. [6] + [6, 1] is [6, 6]
+  broadcast->flat = mA.NumElements() == output_shape.num_elements() &&
+                    mB.NumElements() == output_shape.num_elements();
+  broadcast->index_a = MakeBroadcastIndex(bcast.x_reshape(), bcast.result_shape());
+  broadcast->index_b = MakeBroadcastIndex(bcast.y_reshape(), bcast.result_shape());
+
+  return ctx->forward_input_or_allocate_output({0, 1}, 0, output_shape, mC);
+}
+
+// reads the attributes "activation", "alpha" and "scale" of the fused epilogue
+inline Status GetEpilogueAttrs(OpKernelConstruction* ctx, Epilogue* epilogue) {
+  string activation;
+  TF_RETURN_IF_ERROR(ctx->GetAttr("activation", &activation));
+  TF_RETURN_IF_ERROR(ctx->GetAttr("alpha", &epilogue->alpha));
+  TF_RETURN_IF_ERROR(ctx->GetAttr("scale", &epilogue->scale));
+
+  if (activation == "none")
+    epilogue->activation = Activation::kNone;
+  else if (activation == "relu")
+    epilogue->activation = Activation::kRelu;
+  else if (activation == "leaky_relu")
+    epilogue->activation = Activation::kLeakyRelu;
+  else if (activation == "gelu")
+    epilogue->activation = Activation::kGelu;
+  else
+    return errors::InvalidArgument("Unknown activation: ", activation);
+
+  if (epilogue->alpha < 0)
+    return errors::InvalidArgument("alpha must be non-negative, got ", epilogue->alpha);
+  return Status::OK();
+}
+
+}  // namespace functor
+
+
+// Forward-Pass of a stamped out op (CPU, GPU)
+// --------------------------------------------------
+// Same attributes, broadcasting and buffer forwarding as "MatrixAdd" with
+// "Op" in place of the sum.
+template<typename Device, typename Op, typename Dtype>
+class ElementwiseBinaryOp: public OpKernel {
+ public:
+  explicit ElementwiseBinaryOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+    OP_REQUIRES_OK(ctx,
+                   ::tensorflow::functor::GetEpilogueAttrs(ctx, &epilogue_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& mA = ctx->input(0);
+    const Tensor& mB = ctx->input(1);
+
+    ::tensorflow::functor::BinaryBroadcast broadcast;
+    Tensor* mC = nullptr;
+    OP_REQUIRES_OK(ctx, ::tensorflow::functor::PrepareBinaryOp(ctx, &broadcast, &mC));
+
+    MATRIX_ADD_TRACE(type_string().c_str(), broadcast.flat ? "flat" : "broadcast", *mC,
+                     mA.TotalBytes() + mB.TotalBytes() + mC->TotalBytes());
+
+    if (broadcast.flat) {
+      ::tensorflow::functor::ElementwiseBinaryFunctor<Device, Op, Dtype>()(ctx,
+          mA, mB, mC, static_cast<Dtype>(bias_), epilogue_);
+    } else {
+      ::tensorflow::functor::ElementwiseBinaryBroadcastFunctor<Device, Op, Dtype>()(ctx,
+          mA, mB, mC, static_cast<Dtype>(bias_), epilogue_,
+          broadcast.index_a, broadcast.index_b);
+    }
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(ElementwiseBinaryOp);
+  float bias_;
+  ::tensorflow::functor::Epilogue epilogue_;
+};
+
+}  // namespace tensorflow
+
+#endif  // MATRIX_ADD_KERNELS_ELEMENTWISE_BINARY_OP_H_
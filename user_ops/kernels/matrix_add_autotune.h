@@ -0,0 +1,107 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_MATRIX_ADD_AUTOTUNE_H_
+#define MATRIX_ADD_KERNELS_MATRIX_ADD_AUTOTUNE_H_
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace functor {
+
+// launch parameters of the (flat) forward kernels
+struct ForwardParams {
+  int thread_per_block;
+  bool vectorized;
+};
+
+// Process-wide map from "device/dtype/activation/size-bucket" to the fastest
+// launch parameters measured so far, similar to TF's "AutoTuneMap" for
+// convolutions.
+//
+// Environment variables:
+//   MATRIX_ADD_USE_AUTOTUNE=0  disables tuning, the default parameters are
+//                              used (the same choice on every run)
+//   MATRIX_ADD_AUTOTUNE_FILE   file the results are loaded from on first
+//                              use and appended to, so a restarted process
+//                              skips the tuning
+//   MATRIX_ADD_VECTORIZED=0    never uses the vectorized kernels (e.g. to
+//                              benchmark the scalar ones)
+class ForwardAutotuneMap {
+ public:
+  static ForwardAutotuneMap* Global() {
+    static ForwardAutotuneMap* map = new ForwardAutotuneMap();
+    return map;
+  }
+
+  bool enabled() const { return enabled_; }
+  bool vectorize() const { return vectorize_; }
+
+  bool Find(const string& key, ForwardParams* params) const {
+    mutex_lock lock(mu_);
+    auto it = params_.find(key);
+    if (it == params_.end())
+      return false;
+    *params = it->second;
+    return true;
+  }
+
+  void Insert(const string& key, const ForwardParams& params) {
+    mutex_lock lock(mu_);
+    if (!params_.emplace(key, params).second)
+      return;  // another thread was faster
+
+    VLOG(1) << "MatrixAdd autotune " << key << ": " << params.thread_per_block
+            << " threads, vectorized " << params.vectorized;
+    if (!file_.empty()) {
+      std::ofstream out(file_, std::ios::app);
+      out << key << " " << params.thread_per_block << " " << params.vectorized << "\n";
+    }
+  }
+
+ private:
+  ForwardAutotuneMap() {
+    TF_CHECK_OK(ReadBoolFromEnvVar("MATRIX_ADD_USE_AUTOTUNE", true, &enabled_));
+    TF_CHECK_OK(ReadStringFromEnvVar("MATRIX_ADD_AUTOTUNE_FILE", "", &file_));
+    TF_CHECK_OK(ReadBoolFromEnvVar("MATRIX_ADD_VECTORIZED", true, &vectorize_));
+
+    if (!file_.empty()) {
+      std::ifstream in(file_);
+      string line;
+      while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        string key;
+        ForwardParams params;
+        if (!(fields >> key >> params.thread_per_block >> params.vectorized))
+          continue;
+        // e.g. an edited file, the limit of the device is checked on use
+        if (params.thread_per_block <= 0 || params.thread_per_block % 32 != 0 ||
+            params.thread_per_block > 1024) {
+          LOG(WARNING) << "Ignoring MatrixAdd autotune entry " << key << " in " << file_
+                       << ": " << params.thread_per_block << " threads per block";
+          continue;
+        }
+        params_.emplace(key, params);
+      }
+    }
+  }
+
+  TF_DISALLOW_COPY_AND_ASSIGN(ForwardAutotuneMap);
+
+  bool enabled_;
+  bool vectorize_;
+  string file_;
+  mutable mutex mu_;
+  std::map<string, ForwardParams> params_ GUARDED_BY(mu_);
+};
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // MATRIX_ADD_KERNELS_MATRIX_ADD_AUTOTUNE_H_
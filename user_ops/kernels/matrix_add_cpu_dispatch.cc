@@ -0,0 +1,54 @@
+// ComputerGraphics Tuebingen, 2018
+
+#include <cstdlib>
+#include <cstring>
+
+#include "matrix_add_cpu_simd.h"
+
+namespace matrix_add_simd {
+
+namespace generic { extern const Kernels kernels; }
+#if MATRIX_ADD_X86_DISPATCH
+namespace sse42 { extern const Kernels kernels; }
+namespace avx2 { extern const Kernels kernels; }
+namespace avx512 { extern const Kernels kernels; }
+#endif
+
+namespace {
+
+const Kernels* Select() {
+  const Kernels* supported[4] = {&generic::kernels, nullptr, nullptr, nullptr};
+#if MATRIX_ADD_X86_DISPATCH
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2"))
+    supported[1] = &sse42::kernels;
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    supported[2] = &avx2::kernels;
+  if (__builtin_cpu_supports("avx512f"))
+    supported[3] = &avx512::kernels;
+#endif
+
+  // an explicitly requested instruction set (if supported)
+  const char* isa = std::getenv("MATRIX_ADD_CPU_ISA");
+  if (isa != nullptr) {
+    for (const Kernels* kernels : supported) {
+      if (kernels != nullptr && std::strcmp(kernels->isa, isa) == 0)
+        return kernels;
+    }
+  }
+
+  for (int k = 3; k > 0; --k) {
+    if (supported[k] != nullptr)
+      return supported[k];
+  }
+  return supported[0];
+}
+
+}  // namespace
+
+const Kernels& Get() {
+  static const Kernels* kernels = Select();
+  return *kernels;
+}
+
+}  // namespace matrix_add_simd
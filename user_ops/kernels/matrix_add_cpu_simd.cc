@@ -0,0 +1,173 @@
+// ComputerGraphics Tuebingen, 2018
+
+// compiled once per instruction set with "-DMATRIX_ADD_ISA=<name>" and the
+// matching compiler flags, see "matrix_add_cpu_simd.h"
+
+#include <cstring>
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "matrix_add_cpu_simd.h"
+
+#ifndef MATRIX_ADD_ISA
+#error "MATRIX_ADD_ISA has to be defined"
+#endif
+
+#define MATRIX_ADD_STR_(x) #x
+#define MATRIX_ADD_STR(x) MATRIX_ADD_STR_(x)
+
+namespace matrix_add_simd {
+namespace MATRIX_ADD_ISA {
+
+namespace {
+
+// the loops are vectorized by the compiler for the ISA of this variant,
+// "c" may be the same buffer as "a" or "b" (forwarded input). The sum is
+// scaled in the same type as by "tensorflow::functor::ApplyScale".
+template <typename T, int A>
+void AddLoop(const T* a, const T* b, T* c, int64_t size, T bias, float scale, float alpha) {
+  typedef typename std::conditional<std::is_same<T, float>::value, float, double>::type S;
+#pragma omp simd
+  for (int64_t i = 0; i < size; ++i) {
+    const T x = static_cast<T>(static_cast<S>(scale) * (a[i] + b[i])) + bias;
+    if (A == kNone)
+      c[i] = x;
+    else if (A == kRelu)
+      c[i] = x > T(0) ? x : T(0);
+    else
+      c[i] = x > T(0) ? x : static_cast<T>(alpha * x);
+  }
+}
+
+// alignment of the non-temporal stores (the vector width of this ISA)
+#if defined(__AVX512F__)
+constexpr int64_t kStreamAlign = 64;
+#elif defined(__AVX__)
+constexpr int64_t kStreamAlign = 32;
+#else
+constexpr int64_t kStreamAlign = 16;
+#endif
+
+// "dst" has to be aligned to "kStreamAlign", needs a "Fence()" afterwards
+void StreamStore(const char* src, char* dst, int64_t bytes) {
+  int64_t i = 0;
+#if defined(__AVX512F__)
+  for (; i + 64 <= bytes; i += 64)
+    _mm512_stream_si512(reinterpret_cast<__m512i*>(dst + i),
+                        _mm512_loadu_si512(reinterpret_cast<const void*>(src + i)));
+#elif defined(__AVX__)
+  for (; i + 32 <= bytes; i += 32)
+    _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)));
+#elif defined(__SSE2__)
+  for (; i + 16 <= bytes; i += 16)
+    _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i),
+                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+#endif
+  std::memcpy(dst + i, src + i, bytes - i);
+}
+
+// non-temporal stores are weakly ordered, they have to be visible before
+// another thread reads the output
+void Fence() {
+#if defined(__SSE2__)
+  _mm_sfence();
+#endif
+}
+
+// bytes in front of "ptr" up to the next "kStreamAlign" boundary
+int64_t Misalignment(const void* ptr) {
+  const int64_t offset = reinterpret_cast<uintptr_t>(ptr) % kStreamAlign;
+  return offset == 0 ? 0 : kStreamAlign - offset;
+}
+
+void CopyStreaming(const void* src_, void* dst_, int64_t bytes) {
+  const char* src = static_cast<const char*>(src_);
+  char* dst = static_cast<char*>(dst_);
+  int64_t head = Misalignment(dst);
+  head = head < bytes ? head : bytes;
+  std::memcpy(dst, src, head);
+  StreamStore(src + head, dst + head, bytes - head);
+  Fence();
+}
+
+// Chunks of the result are computed into a buffer which stays in L1 and
+// streamed to "c" from there. The inputs are prefetched a few chunks ahead.
+template <typename T, int A>
+void AddStreaming(const T* a, const T* b, T* c, int64_t size, T bias, float scale,
+                  float alpha) {
+  constexpr int64_t kChunk = 4096 / sizeof(T);
+  constexpr int64_t kPrefetchChunks = 2;
+  constexpr int64_t kLine = 64 / sizeof(T);
+
+  // the first elements up to an aligned "c" are stored as usual
+  int64_t first = Misalignment(c) / sizeof(T);
+  first = first < size ? first : size;
+  AddLoop<T, A>(a, b, c, first, bias, scale, alpha);
+
+  alignas(64) T buffer[kChunk];
+  for (; first < size; first += kChunk) {
+    const int64_t n = size - first < kChunk ? size - first : kChunk;
+
+    // prefetching beyond the end of the buffers is harmless
+    for (int64_t i = 0; i < n; i += kLine) {
+      __builtin_prefetch(a + first + kPrefetchChunks * kChunk + i, 0, 0);
+      __builtin_prefetch(b + first + kPrefetchChunks * kChunk + i, 0, 0);
+    }
+
+    AddLoop<T, A>(a + first, b + first, buffer, n, bias, scale, alpha);
+    StreamStore(reinterpret_cast<const char*>(buffer),
+                reinterpret_cast<char*>(c + first), n * sizeof(T));
+  }
+  Fence();
+}
+
+template <typename T>
+void Add(const T* a, const T* b, T* c, int64_t size, T bias, int activation, float scale,
+         float alpha, bool streaming) {
+  switch (activation) {
+    case kRelu:
+      return streaming ? AddStreaming<T, kRelu>(a, b, c, size, bias, scale, alpha) :
+                         AddLoop<T, kRelu>(a, b, c, size, bias, scale, alpha);
+    case kLeakyRelu:
+      return streaming ? AddStreaming<T, kLeakyRelu>(a, b, c, size, bias, scale, alpha) :
+                         AddLoop<T, kLeakyRelu>(a, b, c, size, bias, scale, alpha);
+    default:
+      return streaming ? AddStreaming<T, kNone>(a, b, c, size, bias, scale, alpha) :
+                         AddLoop<T, kNone>(a, b, c, size, bias, scale, alpha);
+  }
+}
+
+// 8-bit values are widened to 32-bit lanes, the signed type is shifted to
+// [0, 255] first
+template <typename Q>
+void QuantizedAdd(const Q* a, const Q* b, Q* c, int64_t size,
+                  int32_t multiplier_a, int32_t multiplier_b, int32_t offset,
+                  int shift, int32_t lowest, int32_t highest) {
+  const int32_t zero = static_cast<Q>(-1) < 0 ? 128 : 0;
+#pragma omp simd
+  for (int64_t i = 0; i < size; ++i) {
+    int32_t q = (offset + (static_cast<int32_t>(a[i]) + zero) * multiplier_a +
+                          (static_cast<int32_t>(b[i]) + zero) * multiplier_b) >> shift;
+    q = q < lowest ? lowest : q;
+    c[i] = static_cast<Q>(q > highest ? highest : q);
+  }
+}
+
+}  // namespace
+
+extern const Kernels kernels = {
+  MATRIX_ADD_STR(MATRIX_ADD_ISA),
+  &Add<float>,
+  &Add<double>,
+  &Add<int>,
+  &CopyStreaming,
+  &QuantizedAdd<int8_t>,
+  &QuantizedAdd<uint8_t>
+};
+
+}  // namespace MATRIX_ADD_ISA
+}  // namespace matrix_add_simd
@@ -0,0 +1,51 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_MATRIX_ADD_CPU_SIMD_H_
+#define MATRIX_ADD_KERNELS_MATRIX_ADD_CPU_SIMD_H_
+
+#include <cstdint>
+
+// Elementwise CPU loops of "activation(scale * (a + b) + bias)", which are compiled
+// once per instruction set (see "add_tf_operation" in CMakeLists.txt) and
+// selected once per process by cpuid. This way a single library runs with
+// full SIMD width on every host without "-march=native".
+//
+// The translation units of the variants must not include TF or Eigen
+// headers: their inline functions would be compiled with different ISA
+// flags and the linker is free to keep any of the copies (ODR).
+namespace matrix_add_simd {
+
+// same values as "tensorflow::functor::Activation"
+enum Activation { kNone = 0, kRelu = 1, kLeakyRelu = 2 };
+
+// With "streaming" the results are written by non-temporal stores, which
+// bypass the cache. This only pays off for outputs much larger than the
+// last level cache, which would otherwise be read-for-ownership into the
+// cache and evict everything else.
+struct Kernels {
+  const char* isa;
+  void (*add_float)(const float* a, const float* b, float* c, int64_t size,
+                    float bias, int activation, float scale, float alpha, bool streaming);
+  void (*add_double)(const double* a, const double* b, double* c, int64_t size,
+                     double bias, int activation, float scale, float alpha, bool streaming);
+  void (*add_int)(const int* a, const int* b, int* c, int64_t size,
+                  int bias, int activation, float scale, float alpha, bool streaming);
+  // memcpy by non-temporal stores
+  void (*copy_streaming)(const void* src, void* dst, int64_t bytes);
+  // quantized "a + b + bias" in fixed point, the same arithmetic as
+  // "tensorflow::functor::QuantizedAddParams"
+  void (*add_qint8)(const int8_t* a, const int8_t* b, int8_t* c, int64_t size,
+                    int32_t multiplier_a, int32_t multiplier_b, int32_t offset,
+                    int shift, int32_t lowest, int32_t highest);
+  void (*add_quint8)(const uint8_t* a, const uint8_t* b, uint8_t* c, int64_t size,
+                     int32_t multiplier_a, int32_t multiplier_b, int32_t offset,
+                     int shift, int32_t lowest, int32_t highest);
+};
+
+// Kernels of the widest instruction set this CPU supports, which can be
+// overridden by MATRIX_ADD_CPU_ISA={generic,sse42,avx2,avx512}.
+const Kernels& Get();
+
+}  // namespace matrix_add_simd
+
+#endif  // MATRIX_ADD_KERNELS_MATRIX_ADD_CPU_SIMD_H_
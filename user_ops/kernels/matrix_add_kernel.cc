@@ -1,45 +1,546 @@
 // ComputerGraphics Tuebingen, 2017
 
+#define EIGEN_USE_THREADS
+
+#include <algorithm>
 #include <cstring>
+#include <type_traits>
 
 #include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/tensor_types.h"
+#include "tensorflow/core/util/env_var.h"
+#include "elementwise_binary_cpu.h"
+#include "matrix_add_cpu_simd.h"
+#include "matrix_add_numa.h"
 #include "matrix_add_op.h"
 
 namespace tensorflow {
 
 namespace functor {
 
+namespace {
+
+// c = activation(scale * (a + b) + bias) for one shard of contiguous memory, the
+// plain loop of the elementwise engine
+template <Activation A>
+using AddShardScalar = ElementwiseBinaryShard<BinaryAdd>::Flat<A>;
+
+// the SIMD loops compiled for several instruction sets (selected at
+// runtime) cover the types and activations which do not need a wider
+// accumulator or a transcendental function
+template <typename Dtype>
+struct SimdAdd {
+  static constexpr bool kSupported = false;
+  static void Run(const Dtype* a, const Dtype* b, Dtype* c, int64 size,
+                  Dtype bias, int activation, float scale, float alpha, bool streaming) {}
+};
+
+template <>
+struct SimdAdd<float> {
+  static constexpr bool kSupported = true;
+  static void Run(const float* a, const float* b, float* c, int64 size,
+                  float bias, int activation, float scale, float alpha, bool streaming) {
+    matrix_add_simd::Get().add_float(a, b, c, size, bias, activation, scale, alpha, streaming);
+  }
+};
+
+template <>
+struct SimdAdd<double> {
+  static constexpr bool kSupported = true;
+  static void Run(const double* a, const double* b, double* c, int64 size,
+                  double bias, int activation, float scale, float alpha, bool streaming) {
+    matrix_add_simd::Get().add_double(a, b, c, size, bias, activation, scale, alpha, streaming);
+  }
+};
+
+template <>
+struct SimdAdd<int> {
+  static constexpr bool kSupported = true;
+  static void Run(const int* a, const int* b, int* c, int64 size,
+                  int bias, int activation, float scale, float alpha, bool streaming) {
+    matrix_add_simd::Get().add_int(a, b, c, size, bias, activation, scale, alpha, streaming);
+  }
+};
+
+static_assert(static_cast<int>(Activation::kNone) == matrix_add_simd::kNone &&
+              static_cast<int>(Activation::kRelu) == matrix_add_simd::kRelu &&
+              static_cast<int>(Activation::kLeakyRelu) == matrix_add_simd::kLeakyRelu,
+              "Activation and matrix_add_simd::Activation are out of sync");
+
+// "streaming" (non-temporal stores) is only supported by the SIMD loops
+template <Activation A>
+struct AddShard {
+  template <typename Dtype>
+  static void Run(const Dtype* a, const Dtype* b, Dtype* c,
+                  int64 size, Dtype bias, float scale, float alpha, bool streaming = false) {
+    if (A != Activation::kGelu && SimdAdd<Dtype>::kSupported)
+      return SimdAdd<Dtype>::Run(a, b, c, size, bias, static_cast<int>(A), scale, alpha,
+                                 streaming);
+    AddShardScalar<A>::Run(a, b, c, size, bias, scale, alpha);
+  }
+};
+
+// same as "AddShard" for broadcasted inputs, the shard [start, end) is
+// given in terms of the flat output index
+template <Activation A>
+using AddBroadcastShard = ElementwiseBinaryShard<BinaryAdd>::Broadcast<A>;
+
+// gradient w.r.t. "a + b" (through the activation and the scale) for the
+// shard [start, end)
+template <Activation A>
+struct ActivationGradShard {
+  template <typename Dtype>
+  static void Run(const Dtype* topdiff, const Dtype* output,
+                  const Dtype* mA, const Dtype* mB, Dtype* grad,
+                  int64 start, int64 end, Dtype bias, float scale, float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+    typedef typename AccumulatorType<Dtype>::type Acc;
+    for (int64 i = start; i < end; ++i) {
+      const Acc x = ActivationFn<A>::kNeedsInput ?
+                    ApplyScale(Acc(mA[index_a(i)]) + Acc(mB[index_b(i)]), scale) + Acc(bias) :
+                    Acc(0);
+      grad[i] = static_cast<Dtype>(ApplyScale(ActivationFn<A>::grad(
+                  Acc(topdiff[i]), x, Acc(output[i]), alpha), scale));
+    }
+  }
+};
+
+// same as "AddBroadcastShard" with one bias per channel (the inner-most
+// axis of the output), "channels" is 1 for a single bias
+template <Activation A>
+struct AddBiasShard {
+  template <typename Dtype>
+  static void Run(const Dtype* mA, const Dtype* mB, const Dtype* bias, int64 channels,
+                  Dtype* mC, int64 start, int64 end, float scale, float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+    typedef typename AccumulatorType<Dtype>::type Acc;
+
+    const int inner = index_a.ndims - 1;
+    const int64 row = index_a.dims[inner];
+    const int64 stride_a = index_a.strides[inner];
+    const int64 stride_b = index_b.strides[inner];
+
+    for (int64 i = start; i < end;) {
+      int64 a = index_a(i);
+      int64 b = index_b(i);
+      const int64 row_end = std::min<int64>(end, (i / row + 1) * row);
+      for (; i < row_end; ++i, a += stride_a, b += stride_b)
+        mC[i] = static_cast<Dtype>(ActivationFn<A>::apply(
+                  ApplyScale(Acc(mA[a]) + Acc(mB[b]), scale) + Acc(bias[i % channels]),
+                  alpha));
+    }
+  }
+};
+
+// same as "ActivationGradShard" with the bias of "AddBiasShard", "grad" is
+// the gradient w.r.t. the bias (not scaled) and "grad_sum" (if not
+// null) the one w.r.t. "a + b"
+template <Activation A>
+struct BiasActivationGradShard {
+  template <typename Dtype>
+  static void Run(const Dtype* topdiff, const Dtype* output,
+                  const Dtype* mA, const Dtype* mB, const Dtype* bias, int64 channels,
+                  Dtype* grad, Dtype* grad_sum, int64 start, int64 end,
+                  float scale, float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+    typedef typename AccumulatorType<Dtype>::type Acc;
+    for (int64 i = start; i < end; ++i) {
+      const Acc x = ActivationFn<A>::kNeedsInput ?
+                    ApplyScale(Acc(mA[index_a(i)]) + Acc(mB[index_b(i)]), scale) +
+                    Acc(bias[i % channels]) : Acc(0);
+      const Acc g = ActivationFn<A>::grad(Acc(topdiff[i]), x, Acc(output[i]), alpha);
+      grad[i] = static_cast<Dtype>(g);
+      if (grad_sum != nullptr)
+        grad_sum[i] = static_cast<Dtype>(ApplyScale(g, scale));
+    }
+  }
+};
+
+// Outputs of at least this many bytes (default 32 MiB, far beyond the last
+// level cache of most hosts) are written by non-temporal stores, which can
+// be changed by the environment variable MATRIX_ADD_NONTEMPORAL_BYTES
+// (e.g. "-1" disables them).
+int64 NonTemporalThreshold() {
+  static const int64 threshold = [] {
+    int64 value;
+    TF_CHECK_OK(ReadInt64FromEnvVar("MATRIX_ADD_NONTEMPORAL_BYTES", 32 << 20, &value));
+    return value;
+  }();
+  return threshold;
+}
+
+bool UseNonTemporalStores(int64 bytes) {
+  return NonTemporalThreshold() >= 0 && bytes >= NonTemporalThreshold();
+}
+
+// "ActivationGradShard" for the rows [start, end) of a sparse gradient
+template <Activation A>
+struct SparseActivationGradShard {
+  template <typename Dtype, typename Index>
+  static void Run(const Dtype* values, const Index* indices,
+                  const Dtype* output, const Dtype* mA, const Dtype* mB, Dtype* grad,
+                  int64 row_size, int64 start, int64 end, Dtype bias, float scale,
+                  float alpha) {
+    typedef typename AccumulatorType<Dtype>::type Acc;
+    for (int64 k = start; k < end; ++k) {
+      const int64 offset = static_cast<int64>(indices[k]) * row_size;
+      for (int64 j = 0; j < row_size; ++j) {
+        const int64 i = offset + j;
+        const Acc x = ActivationFn<A>::kNeedsInput ?
+                      ApplyScale(Acc(mA[i]) + Acc(mB[i]), scale) + Acc(bias) : Acc(0);
+        grad[k * row_size + j] = static_cast<Dtype>(ApplyScale(ActivationFn<A>::grad(
+            Acc(values[k * row_size + j]), x, Acc(output[i]), alpha), scale));
+      }
+    }
+  }
+};
+
+}  // namespace
+
 template <typename Dtype>
 struct MatrixAddFunctor<CPUDevice, Dtype> {
   void operator ()(::tensorflow::OpKernelContext* ctx,
                    const Tensor& mA_,
                    const Tensor& mB_,
                    Tensor *mC_,
-                   Dtype bias) {
-    auto mA = mA_.tensor<Dtype, 4>();
-    auto mB = mB_.tensor<Dtype, 4>();
-    auto mC = mC_->tensor<Dtype, 4>();
+                   Dtype bias,
+                   const Epilogue& epilogue) {
+    // the op is purely elementwise, so we can ignore the 4D layout and
+    // treat all tensors as one flat buffer
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mA_.NumElements();
 
-    mC.setZero();
+    // per element: two loads, one store and two additions
+    // (Eigen uses this to decide on the number and size of the shards)
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::AddCost<Dtype>());
 
-    // get dimensions
-    const int B = mA_.dim_size(0);
-    const int M = mA_.dim_size(1);
-    const int N = mA_.dim_size(2);
-    const int D = mA_.dim_size(3);
+    const bool streaming = UseNonTemporalStores(N * sizeof(Dtype));
+    const NumaSharding& numa = NumaSharding::Get();
 
-    // the computation (easy to read)
-    for (int b = 0; b < B; ++b)
-      for (int r = 0; r < M; ++r)
-        for (int c = 0; c < N; ++c)
-          for (int d = 0; d < D; ++d)
-            mC(b, r, c, d) = mA(b, r, c, d) + mB(b, r, c, d) + bias;
+    // split the buffer across the intra-op thread pool,
+    // every element is written exactly once, no need to zero "mC" first
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      // a shard crossing the boundary of two NUMA parts is split
+      ScopedNumaPin pin(numa);
+      for (int64 i = start; i < end;) {
+        const int node = numa.Node(i, N);
+        const int64 part_end = std::min<int64>(end, numa.PartBegin(node + 1, N));
+        pin.RunOnNode(node);
+        DispatchActivation<AddShard>(epilogue.activation,
+            mA + i, mB + i, mC + i, part_end - i, bias, epilogue.scale, epilogue.alpha,
+            streaming);
+        i = part_end;
+      }
+    });
   }
 };
 
 template struct MatrixAddFunctor<CPUDevice, int>;
 template struct MatrixAddFunctor<CPUDevice, float>;
 template struct MatrixAddFunctor<CPUDevice, double>;
+template struct MatrixAddFunctor<CPUDevice, Eigen::half>;
+template struct MatrixAddFunctor<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBroadcastFunctor<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mC_->NumElements();
+
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::AddCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<AddBroadcastShard>(epilogue.activation,
+          mA, mB, mC, start, end, bias, epilogue.scale, epilogue.alpha, index_a, index_b);
+    });
+  }
+};
+
+template struct MatrixAddBroadcastFunctor<CPUDevice, int>;
+template struct MatrixAddBroadcastFunctor<CPUDevice, float>;
+template struct MatrixAddBroadcastFunctor<CPUDevice, double>;
+template struct MatrixAddBroadcastFunctor<CPUDevice, Eigen::half>;
+template struct MatrixAddBroadcastFunctor<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBiasFunctor<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   Tensor *mC_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    const Dtype* bias = bias_.flat<Dtype>().data();
+    const int64 channels = bias_.NumElements();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mC_->NumElements();
+
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::AddCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<AddBiasShard>(epilogue.activation,
+          mA, mB, bias, channels, mC, start, end, epilogue.scale, epilogue.alpha,
+          index_a, index_b);
+    });
+  }
+};
+
+template struct MatrixAddBiasFunctor<CPUDevice, int>;
+template struct MatrixAddBiasFunctor<CPUDevice, float>;
+template struct MatrixAddBiasFunctor<CPUDevice, double>;
+template struct MatrixAddBiasFunctor<CPUDevice, Eigen::half>;
+template struct MatrixAddBiasFunctor<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddActivationGrad<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_) {
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+    const Dtype* output = output_.flat<Dtype>().data();
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* grad = grad_->flat<Dtype>().data();
+    const int64 N = grad_->NumElements();
+
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::MulCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<ActivationGradShard>(epilogue.activation,
+          topdiff, output, mA, mB, grad, start, end, bias, epilogue.scale, epilogue.alpha,
+          index_a, index_b);
+    });
+  }
+};
+
+template struct MatrixAddActivationGrad<CPUDevice, int>;
+template struct MatrixAddActivationGrad<CPUDevice, float>;
+template struct MatrixAddActivationGrad<CPUDevice, double>;
+template struct MatrixAddActivationGrad<CPUDevice, Eigen::half>;
+template struct MatrixAddActivationGrad<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBiasActivationGrad<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_,
+                   Tensor *grad_sum_) {
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+    const Dtype* output = output_.flat<Dtype>().data();
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    const Dtype* bias = bias_.flat<Dtype>().data();
+    const int64 channels = bias_.NumElements();
+    Dtype* grad = grad_->flat<Dtype>().data();
+    Dtype* grad_sum = grad_sum_ == nullptr ? nullptr : grad_sum_->flat<Dtype>().data();
+    const int64 N = grad_->NumElements();
+
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::MulCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<BiasActivationGradShard>(epilogue.activation,
+          topdiff, output, mA, mB, bias, channels, grad, grad_sum, start, end,
+          epilogue.scale, epilogue.alpha, index_a, index_b);
+    });
+  }
+};
+
+template struct MatrixAddBiasActivationGrad<CPUDevice, int>;
+template struct MatrixAddBiasActivationGrad<CPUDevice, float>;
+template struct MatrixAddBiasActivationGrad<CPUDevice, double>;
+template struct MatrixAddBiasActivationGrad<CPUDevice, Eigen::half>;
+template struct MatrixAddBiasActivationGrad<CPUDevice, bfloat16>;
+
+
+template <typename Dtype, typename Index>
+struct MatrixAddSparseActivationGrad<CPUDevice, Dtype, Index> {
+  int64 operator ()(::tensorflow::OpKernelContext* ctx,
+                    const Tensor& values_,
+                    const Tensor& indices_,
+                    const Tensor& output_,
+                    const Tensor& mA_,
+                    const Tensor& mB_,
+                    Dtype bias,
+                    const Epilogue& epilogue,
+                    Tensor *grad_) {
+    const Index* indices = indices_.flat<Index>().data();
+    const int64 K = indices_.NumElements();
+    const int64 rows = output_.dim_size(0);
+    for (int64 k = 0; k < K; ++k) {
+      if (indices[k] < 0 || indices[k] >= rows)
+        return k;
+    }
+
+    const int64 row_size = K == 0 ? 0 : values_.NumElements() / K;
+    const Eigen::TensorOpCost cost(4 * row_size * sizeof(Dtype), row_size * sizeof(Dtype),
+                                   2 * row_size * Eigen::TensorOpCost::MulCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(K, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      DispatchActivation<SparseActivationGradShard>(epilogue.activation,
+          values_.flat<Dtype>().data(), indices, output_.flat<Dtype>().data(),
+          mA_.flat<Dtype>().data(), mB_.flat<Dtype>().data(), grad_->flat<Dtype>().data(),
+          row_size, start, end, bias, epilogue.scale, epilogue.alpha);
+    });
+    return -1;
+  }
+};
+
+template struct MatrixAddSparseActivationGrad<CPUDevice, float, int32>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, float, int64>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, double, int32>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, double, int64>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, Eigen::half, int32>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, Eigen::half, int64>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, bfloat16, int32>;
+template struct MatrixAddSparseActivationGrad<CPUDevice, bfloat16, int64>;
+
+
+template <typename Dtype>
+struct MatrixAddNFunctor<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& inputs,
+                   Tensor *mC_,
+                   Dtype bias) {
+    Dtype* mC = mC_->flat<Dtype>().data();
+    const int64 N = mC_->NumElements();
+    const int K = inputs.size();
+
+    const Eigen::TensorOpCost cost(K * sizeof(Dtype), sizeof(Dtype),
+                                   K * Eigen::TensorOpCost::AddCost<Dtype>());
+
+    typedef typename AccumulatorType<Dtype>::type Acc;
+    if (!std::is_same<Acc, Dtype>::value) {
+      // accumulate a few elements at a time in the wider type,
+      // such that the result is only rounded once
+      ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+      [&](Eigen::Index start, Eigen::Index end) {
+        constexpr int64 kChunk = 256;
+        Acc sum[kChunk];
+        for (int64 first = start; first < end; first += kChunk) {
+          const int64 size = std::min(kChunk, static_cast<int64>(end) - first);
+          std::fill(sum, sum + size, Acc(bias));
+          for (int k = 0; k < K; ++k) {
+            const Dtype* ak = inputs[k]->flat<Dtype>().data() + first;
+            for (int64 i = 0; i < size; ++i)
+              sum[i] += Acc(ak[i]);
+          }
+          for (int64 i = 0; i < size; ++i)
+            mC[first + i] = static_cast<Dtype>(sum[i]);
+        }
+      });
+      return;
+    }
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      typename TTypes<Dtype>::UnalignedFlat c(mC + start, end - start);
+
+      // a shard is small enough to stay in cache while we accumulate
+      // all inputs into it, so memory is only touched once per input
+      typename TTypes<Dtype>::UnalignedConstFlat a0(
+        inputs[0]->flat<Dtype>().data() + start, end - start);
+      c = a0 + a0.constant(bias);
+
+      for (int k = 1; k < K; ++k) {
+        typename TTypes<Dtype>::UnalignedConstFlat ak(
+          inputs[k]->flat<Dtype>().data() + start, end - start);
+        c += ak;
+      }
+    });
+  }
+};
+
+template struct MatrixAddNFunctor<CPUDevice, int>;
+template struct MatrixAddNFunctor<CPUDevice, float>;
+template struct MatrixAddNFunctor<CPUDevice, double>;
+template struct MatrixAddNFunctor<CPUDevice, Eigen::half>;
+template struct MatrixAddNFunctor<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddGroupedFunctor<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& mA_,
+                   const std::vector<const Tensor*>& mB_,
+                   const std::vector<Tensor*>& mC_,
+                   Dtype bias) {
+    const int K = mC_.size();
+
+    // all groups are concatenated (virtually) into one flat range which is
+    // split across the thread pool, "offsets[k]" is the start of group "k"
+    std::vector<int64> offsets(K + 1, 0);
+    for (int k = 0; k < K; ++k)
+      offsets[k + 1] = offsets[k] + mC_[k]->NumElements();
+
+    const Eigen::TensorOpCost cost(2 * sizeof(Dtype), sizeof(Dtype),
+                                   2 * Eigen::TensorOpCost::AddCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(offsets[K], cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      // last group starting at or before "start"
+      int k = std::upper_bound(offsets.begin(), offsets.end(), start) - offsets.begin() - 1;
+      for (int64 i = start; i < end; ++k) {
+        const int64 first = i - offsets[k];
+        const int64 size = std::min<int64>(end, offsets[k + 1]) - i;
+        AddShard<Activation::kNone>::Run(mA_[k]->flat<Dtype>().data() + first,
+                                         mB_[k]->flat<Dtype>().data() + first,
+                                         mC_[k]->flat<Dtype>().data() + first,
+                                         size, bias, 1.f, 0.f);
+        i += size;
+      }
+    });
+  }
+};
+
+template struct MatrixAddGroupedFunctor<CPUDevice, int>;
+template struct MatrixAddGroupedFunctor<CPUDevice, float>;
+template struct MatrixAddGroupedFunctor<CPUDevice, double>;
+template struct MatrixAddGroupedFunctor<CPUDevice, Eigen::half>;
+template struct MatrixAddGroupedFunctor<CPUDevice, bfloat16>;
 
 
 template <typename Dtype>
@@ -50,15 +551,36 @@ struct MatrixAddGrad<CPUDevice, Dtype> {
                    Tensor *grad_mB_) {
     const int N = topdiff_.NumElements();
 
-    grad_mA_->flat<Dtype>().setZero();
-    grad_mB_->flat<Dtype>().setZero();
-
     const Dtype* topdiff = topdiff_.flat<Dtype>().data();
     Dtype* grad_mA = grad_mA_->flat<Dtype>().data();
     Dtype* grad_mB = grad_mB_->flat<Dtype>().data();
 
-    std::memcpy(grad_mA, topdiff, N * sizeof(Dtype));
-    std::memcpy(grad_mB, topdiff, N * sizeof(Dtype));
+    const int64 bytes = N * sizeof(Dtype);
+    if (UseNonTemporalStores(bytes)) {
+      // split into shards of whole cache lines across the thread pool
+      const int64 kLine = 64;
+      const Eigen::TensorOpCost cost(kLine, 2 * kLine, 0);
+      const auto& copy = matrix_add_simd::Get().copy_streaming;
+      const char* src = reinterpret_cast<const char*>(topdiff);
+
+      ctx->eigen_device<CPUDevice>().parallelFor((bytes + kLine - 1) / kLine, cost,
+      [&](Eigen::Index start, Eigen::Index end) {
+        const int64 first = start * kLine;
+        const int64 size = std::min<int64>(bytes, end * kLine) - first;
+        // outputs might share the buffer of "topdiff" (forwarded input)
+        if (grad_mA != topdiff)
+          copy(src + first, reinterpret_cast<char*>(grad_mA) + first, size);
+        if (grad_mB != topdiff)
+          copy(src + first, reinterpret_cast<char*>(grad_mB) + first, size);
+      });
+      return;
+    }
+
+    // outputs might share the buffer of "topdiff" (forwarded input)
+    if (grad_mA != topdiff)
+      std::memcpy(grad_mA, topdiff, bytes);
+    if (grad_mB != topdiff)
+      std::memcpy(grad_mB, topdiff, bytes);
     // for (int i = 0; i < N; ++i) {
     //   grad_mA[i] = topdiff[i];
     //   grad_mB[i] = topdiff[i];
@@ -69,6 +591,155 @@ struct MatrixAddGrad<CPUDevice, Dtype> {
 template struct MatrixAddGrad<CPUDevice, int>;
 template struct MatrixAddGrad<CPUDevice, float>;
 template struct MatrixAddGrad<CPUDevice, double>;
+template struct MatrixAddGrad<CPUDevice, Eigen::half>;
+template struct MatrixAddGrad<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddNGrad<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const std::vector<Tensor*>& grads_) {
+    const int N = topdiff_.NumElements();
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+
+    for (Tensor* grad_ : grads_) {
+      Dtype* grad = grad_->flat<Dtype>().data();
+      // outputs might share the buffer of "topdiff" (forwarded input)
+      if (grad != topdiff)
+        std::memcpy(grad, topdiff, N * sizeof(Dtype));
+    }
+  }
+};
+
+template struct MatrixAddNGrad<CPUDevice, int>;
+template struct MatrixAddNGrad<CPUDevice, float>;
+template struct MatrixAddNGrad<CPUDevice, double>;
+template struct MatrixAddNGrad<CPUDevice, Eigen::half>;
+template struct MatrixAddNGrad<CPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddGradReduce<CPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   Tensor *grad_,
+                   const BroadcastReduction& reduction) {
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+    Dtype* grad = grad_->flat<Dtype>().data();
+    const int64 N = grad_->NumElements();
+
+    // each gradient entry sums "reduce_size" values in a fixed order,
+    // so the result does not depend on the sharding
+    const Eigen::TensorOpCost cost(reduction.reduce_size * sizeof(Dtype), sizeof(Dtype),
+                                   reduction.reduce_size * Eigen::TensorOpCost::AddCost<Dtype>());
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, cost,
+    [&](Eigen::Index start, Eigen::Index end) {
+      typedef typename AccumulatorType<Dtype>::type Acc;
+      for (int64 g = start; g < end; ++g) {
+        const Dtype* src = topdiff + reduction.kept(g);
+        Acc sum = Acc(0);
+        for (int64 r = 0; r < reduction.reduce_size; ++r)
+          sum += Acc(src[reduction.reduced(r)]);
+        grad[g] = static_cast<Dtype>(sum);
+      }
+    });
+  }
+};
+
+template struct MatrixAddGradReduce<CPUDevice, int>;
+template struct MatrixAddGradReduce<CPUDevice, float>;
+template struct MatrixAddGradReduce<CPUDevice, double>;
+template struct MatrixAddGradReduce<CPUDevice, Eigen::half>;
+template struct MatrixAddGradReduce<CPUDevice, bfloat16>;
+
+
+namespace {
+
+// the quantized sum of contiguous buffers runs in the SIMD loops
+void SimdQuantizedAdd(const int8* a, const int8* b, int8* c, int64 size,
+                      const QuantizedAddParams& p) {
+  matrix_add_simd::Get().add_qint8(a, b, c, size, p.multiplier_a, p.multiplier_b,
+                                   p.offset, p.shift, p.lowest, p.highest);
+}
+
+void SimdQuantizedAdd(const uint8* a, const uint8* b, uint8* c, int64 size,
+                      const QuantizedAddParams& p) {
+  matrix_add_simd::Get().add_quint8(a, b, c, size, p.multiplier_a, p.multiplier_b,
+                                    p.offset, p.shift, p.lowest, p.highest);
+}
+
+// per element: two loads, one store, two multiply-adds and the clamp
+template <typename S>
+Eigen::TensorOpCost QuantizedAddCost() {
+  return Eigen::TensorOpCost(2 * sizeof(S), sizeof(S),
+                             2 * Eigen::TensorOpCost::MulCost<int32>() +
+                             4 * Eigen::TensorOpCost::AddCost<int32>());
+}
+
+}  // namespace
+
+template <typename T>
+struct QuantizedMatrixAddFunctor<CPUDevice, T> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params) {
+    typedef typename QuantizedStorage<T>::type S;
+    const S* mA = reinterpret_cast<const S*>(mA_.flat<T>().data());
+    const S* mB = reinterpret_cast<const S*>(mB_.flat<T>().data());
+    S* mC = reinterpret_cast<S*>(mC_->flat<T>().data());
+    const int64 N = mA_.NumElements();
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, QuantizedAddCost<S>(),
+    [&](Eigen::Index start, Eigen::Index end) {
+      SimdQuantizedAdd(mA + start, mB + start, mC + start, end - start, params);
+    });
+  }
+};
+
+template struct QuantizedMatrixAddFunctor<CPUDevice, qint8>;
+template struct QuantizedMatrixAddFunctor<CPUDevice, quint8>;
+
+
+template <typename T>
+struct QuantizedMatrixAddBroadcastFunctor<CPUDevice, T> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    typedef typename QuantizedStorage<T>::type S;
+    const S* mA = reinterpret_cast<const S*>(mA_.flat<T>().data());
+    const S* mB = reinterpret_cast<const S*>(mB_.flat<T>().data());
+    S* mC = reinterpret_cast<S*>(mC_->flat<T>().data());
+    const int64 N = mC_->NumElements();
+
+    // the index arithmetic is only done once per row of the inner-most axis
+    const int inner = index_a.ndims - 1;
+    const int64 row = index_a.dims[inner];
+    const int64 stride_a = index_a.strides[inner];
+    const int64 stride_b = index_b.strides[inner];
+
+    ctx->eigen_device<CPUDevice>().parallelFor(N, QuantizedAddCost<S>(),
+    [&](Eigen::Index start, Eigen::Index end) {
+      for (int64 i = start; i < end;) {
+        int64 a = index_a(i);
+        int64 b = index_b(i);
+        const int64 row_end = std::min<int64>(end, (i / row + 1) * row);
+        for (; i < row_end; ++i, a += stride_a, b += stride_b)
+          mC[i] = params(mA[a], mB[b]);
+      }
+    });
+  }
+};
+
+template struct QuantizedMatrixAddBroadcastFunctor<CPUDevice, qint8>;
+template struct QuantizedMatrixAddBroadcastFunctor<CPUDevice, quint8>;
 
 
 } // namespace functor
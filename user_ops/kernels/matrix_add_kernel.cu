@@ -4,24 +4,585 @@
 
 #define EIGEN_USE_GPU
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <cuda_fp16.h>
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/cuda_kernel_helper.h"
+#include "elementwise_binary_gpu.cu.h"
+#include "matrix_add_autotune.h"
 #include "matrix_add_op.h"
+#include "matrix_add_trace.h"
 
 
 namespace {
 
 using CudaLaunchConfig = ::tensorflow::CudaLaunchConfig;
+using Activation = ::tensorflow::functor::Activation;
+using BroadcastIndex = ::tensorflow::functor::BroadcastIndex;
+using ::tensorflow::functor::AccumulatorType;
+using ::tensorflow::functor::ActivationFn;
+using ::tensorflow::functor::ForwardParams;
+using ::tensorflow::functor::QuantizedAddParams;
+
+// the flat and broadcasted forward kernels are the ones of the elementwise
+// engine with "BinaryAdd" (see "elementwise_binary_gpu.cu.h")
+using ::tensorflow::functor::BinaryAdd;
+using ::tensorflow::functor::elementwise::GetLaunchConfig;
+using ::tensorflow::functor::elementwise::LaunchConfig;
+using ::tensorflow::functor::elementwise::LoadReadOnly;
+using ::tensorflow::functor::elementwise::Vectorized;
+
+// activation(scale * (a + b) + bias), computed in the accumulator type of "T"
+template<Activation A, typename T>
+__device__ __forceinline__ T AddActivate(const T a, const T b, const T bias,
+                                         const float scale, const float alpha) {
+  return ::tensorflow::functor::elementwise::BinaryActivate<BinaryAdd, A>(a, b, bias,
+                                                                          scale, alpha);
+}
+
+
+// "forward_broadcast" with one bias per channel ("channels" is 1 for a
+// single bias), the bias stays on the device
+template<typename T, Activation A>
+__global__ void forward_bias(T* top,
+                             const int N,
+                             const T* matrixA,
+                             const T* matrixB,
+                             const T* bias,
+                             const int channels,
+                             const float scale,
+                             const float alpha,
+                             const BroadcastIndex index_a,
+                             const BroadcastIndex index_b) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    top[i] = AddActivate<A>(LoadReadOnly(matrixA + index_a(i)),
+                            LoadReadOnly(matrixB + index_b(i)),
+                            LoadReadOnly(bias + i % channels), scale, alpha);
+  }
+}
+
+
+// gradient w.r.t. "a + b" (through the activation and the scale)
+template<typename T, Activation A>
+__global__ void backward_activation(const T* top_diff,
+                                    const int N,
+                                    const T* top,
+                                    const T* matrixA,
+                                    const T* matrixB,
+                                    const T bias,
+                                    const float scale,
+                                    const float alpha,
+                                    const BroadcastIndex index_a,
+                                    const BroadcastIndex index_b,
+                                    T* grad) {
+  typedef typename AccumulatorType<T>::type Acc;
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    const Acc x = ActivationFn<A>::kNeedsInput ?
+                  ApplyScale(Acc(matrixA[index_a(i)]) + Acc(matrixB[index_b(i)]), scale) +
+                  Acc(bias) : Acc(0);
+    grad[i] = static_cast<T>(ApplyScale(
+                ActivationFn<A>::grad(Acc(top_diff[i]), x, Acc(top[i]), alpha), scale));
+  }
+}
+
+
+// "backward_activation" with the bias of "forward_bias", "grad" is the
+// gradient w.r.t. the bias (not scaled) and "grad_sum" (if not null)
+// the one w.r.t. "a + b"
+template<typename T, Activation A>
+__global__ void backward_activation_bias(const T* top_diff,
+                                         const int N,
+                                         const T* top,
+                                         const T* matrixA,
+                                         const T* matrixB,
+                                         const T* bias,
+                                         const int channels,
+                                         const float scale,
+                                         const float alpha,
+                                         const BroadcastIndex index_a,
+                                         const BroadcastIndex index_b,
+                                         T* grad,
+                                         T* grad_sum) {
+  typedef typename AccumulatorType<T>::type Acc;
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    const Acc x = ActivationFn<A>::kNeedsInput ?
+                  ApplyScale(Acc(matrixA[index_a(i)]) + Acc(matrixB[index_b(i)]), scale) +
+                  Acc(bias[i % channels]) : Acc(0);
+    const Acc g = ActivationFn<A>::grad(Acc(top_diff[i]), x, Acc(top[i]), alpha);
+    grad[i] = static_cast<T>(g);
+    if (grad_sum != nullptr)
+      grad_sum[i] = static_cast<T>(ApplyScale(g, scale));
+  }
+}
+
+
+// "backward_activation" for a sparse gradient of "K" rows of "row_size",
+// rows with an invalid index get a zero gradient
+template<typename T, typename Index, Activation A>
+__global__ void backward_activation_sparse(const T* values,
+                                           const Index* indices,
+                                           const int K,
+                                           const int row_size,
+                                           const int rows,
+                                           const T* top,
+                                           const T* matrixA,
+                                           const T* matrixB,
+                                           const T bias,
+                                           const float scale,
+                                           const float alpha,
+                                           T* grad) {
+  typedef typename AccumulatorType<T>::type Acc;
+  const int N = K * row_size;
+  for (int n = blockIdx.x * blockDim.x + threadIdx.x; n < N; n += blockDim.x * gridDim.x) {
+    const Index row = indices[n / row_size];
+    if (row < 0 || row >= rows) {
+      grad[n] = T(0);
+      continue;
+    }
+    const int i = static_cast<int>(row) * row_size + n % row_size;
+    const Acc x = ActivationFn<A>::kNeedsInput ?
+                  ApplyScale(Acc(matrixA[i]) + Acc(matrixB[i]), scale) + Acc(bias) : Acc(0);
+    grad[n] = static_cast<T>(ApplyScale(
+                ActivationFn<A>::grad(Acc(values[n]), x, Acc(top[i]), alpha), scale));
+  }
+}
+
+
+// "stream" is the stream of the op ("d.stream()") or a side stream of the
+// chunked forward pass (see "SideStreams"), "params.vectorized" requires
+// all buffers to be aligned to 16 bytes
+template<Activation A>
+struct LaunchForward {
+  template<typename T>
+  static void Run(const ::tensorflow::GPUDevice& d, cudaStream_t stream,
+                  const ForwardParams& params, T* top, const int N,
+                  const T* matrixA, const T* matrixB, const T bias,
+                  const float scale, const float alpha) {
+    ::tensorflow::functor::elementwise::Launch<BinaryAdd>::Forward<A>::Run(
+      d, stream, params.thread_per_block, params.vectorized,
+      top, N, matrixA, matrixB, bias, scale, alpha);
+  }
+};
+
+
+// Splits the flat forward pass of very large outputs into chunks, which run
+// concurrently on several streams and hence can overlap with kernels of
+// other ops.
+//
+// Environment variables:
+//   MATRIX_ADD_GPU_STREAMS=<k>           number of chunks (default 1, off)
+//   MATRIX_ADD_GPU_STREAM_MIN_BYTES=<n>  smallest output which is split
+//                                        (default 256 MiB)
+//
+// Chunk 0 runs on the stream of the op, the others on side streams (per
+// device, created on first use). These wait for an event recorded on the
+// op stream and the op stream waits for events recorded after their chunk.
+// All work enqueued on the op stream before and after is hence ordered
+// w.r.t. all chunks, which is all the allocator of TensorFlow relies on.
+class SideStreams {
+ public:
+  static SideStreams* Global() {
+    static SideStreams* streams = new SideStreams();
+    return streams;
+  }
+
+  bool Split(::tensorflow::int64 bytes) const { return num_streams_ > 1 && bytes >= min_bytes_; }
+  int num_streams() const { return num_streams_; }
+
+  // enqueues "launch(stream, k)" for all chunks "k < num_streams()"
+  template<typename F>
+  void Run(cudaStream_t main, F launch) {
+    int device = 0;
+    cudaGetDevice(&device);
+
+    // events are re-recorded by the next call, the mutex keeps each
+    // record-wait pair together
+    ::tensorflow::mutex_lock lock(mu_);
+    PerDevice& side = Get(device);
+    cudaEventRecord(side.fork, main);
+    for (int k = 1; k < num_streams_; ++k) {
+      cudaStreamWaitEvent(side.streams[k - 1], side.fork, 0);
+      launch(side.streams[k - 1], k);
+      cudaEventRecord(side.joins[k - 1], side.streams[k - 1]);
+    }
+    launch(main, 0);
+    for (int k = 1; k < num_streams_; ++k)
+      cudaStreamWaitEvent(main, side.joins[k - 1], 0);
+  }
+
+ private:
+  struct PerDevice {
+    cudaEvent_t fork;
+    std::vector<cudaStream_t> streams;
+    std::vector<cudaEvent_t> joins;
+  };
+
+  SideStreams() {
+    ::tensorflow::int64 num_streams = 1;
+    TF_CHECK_OK(::tensorflow::ReadInt64FromEnvVar("MATRIX_ADD_GPU_STREAMS", 1, &num_streams));
+    TF_CHECK_OK(::tensorflow::ReadInt64FromEnvVar("MATRIX_ADD_GPU_STREAM_MIN_BYTES",
+                                                  256 << 20, &min_bytes_));
+    num_streams_ = std::max<int>(1, num_streams);
+  }
+
+  PerDevice& Get(int device) {
+    auto it = devices_.find(device);
+    if (it != devices_.end())
+      return it->second;
+
+    PerDevice& side = devices_[device];
+    cudaEventCreateWithFlags(&side.fork, cudaEventDisableTiming);
+    side.streams.resize(num_streams_ - 1);
+    side.joins.resize(num_streams_ - 1);
+    for (int k = 0; k < num_streams_ - 1; ++k) {
+      cudaStreamCreateWithFlags(&side.streams[k], cudaStreamNonBlocking);
+      cudaEventCreateWithFlags(&side.joins[k], cudaEventDisableTiming);
+    }
+    return side;
+  }
+
+  int num_streams_;
+  ::tensorflow::int64 min_bytes_;
+  ::tensorflow::mutex mu_;
+  std::map<int, PerDevice> devices_;
+};
+
+
+// Measures all candidate launch parameters of "LaunchForward" and stores the
+// fastest in "best". The candidates write into "scratch" as the actual
+// output might alias an input (forwarded buffer).
+template<Activation A>
+struct TuneForward {
+  template<typename T>
+  static void Run(const ::tensorflow::GPUDevice& d, const bool aligned, ForwardParams* best,
+                  T* scratch, const int N,
+                  const T* matrixA, const T* matrixB, const T bias,
+                  const float scale, const float alpha) {
+    constexpr int kRepeats = 3;
+    cudaEvent_t start, stop;
+    cudaEventCreate(&start);
+    cudaEventCreate(&stop);
+
+    float best_ms = -1;
+    for (const int thread_per_block : {128, 256, 512, 1024}) {
+      if (thread_per_block > d.maxCudaThreadsPerBlock())
+        continue;
+      for (const bool vectorized : {false, true}) {
+        if (vectorized && !aligned)
+          continue;
+
+        const ForwardParams params = {thread_per_block, vectorized};
+        // warm-up
+        LaunchForward<A>::Run(d, d.stream(), params, scratch, N, matrixA, matrixB,
+                              bias, scale, alpha);
+
+        cudaEventRecord(start, d.stream());
+        for (int r = 0; r < kRepeats; ++r)
+          LaunchForward<A>::Run(d, d.stream(), params, scratch, N, matrixA, matrixB,
+                                bias, scale, alpha);
+        cudaEventRecord(stop, d.stream());
+        cudaEventSynchronize(stop);
+
+        float ms = 0;
+        cudaEventElapsedTime(&ms, start, stop);
+        if (best_ms < 0 || ms < best_ms) {
+          best_ms = ms;
+          *best = params;
+        }
+      }
+    }
+
+    cudaEventDestroy(start);
+    cudaEventDestroy(stop);
+  }
+};
+
+
+// Pinned host buffers and a copy stream (per device, allocated on first
+// use) to stage inputs in host memory (see "MatrixAddHostFunctor"). There
+// are "kSlots" buffers of MATRIX_ADD_HOST_CHUNK_BYTES each (default 4 MiB),
+// shared by all ops on the device. A slot is claimed for a single chunk,
+// the lock is only held to claim and to release it.
+class HostStaging {
+ public:
+  enum { kSlots = 3 };
+
+  struct PerDevice {
+    cudaStream_t copy_stream;
+    void* pinned[kSlots];
+    cudaEvent_t copied[kSlots];  // the last H2D copy out of the slot is done
+    bool claimed[kSlots];
+    int next;                    // slot to try first
+  };
+
+  static HostStaging* Global() {
+    static HostStaging* staging = new HostStaging();
+    return staging;
+  }
+
+  ::tensorflow::int64 chunk_bytes() const { return chunk_bytes_; }
+
+  // buffers of the current device
+  PerDevice* Get() {
+    int device = 0;
+    cudaGetDevice(&device);
+
+    ::tensorflow::mutex_lock lock(mu_);
+    auto it = devices_.find(device);
+    if (it == devices_.end()) {
+      PerDevice& buffers = devices_[device];
+      cudaStreamCreateWithFlags(&buffers.copy_stream, cudaStreamNonBlocking);
+      for (int k = 0; k < kSlots; ++k) {
+        cudaHostAlloc(&buffers.pinned[k], chunk_bytes_, cudaHostAllocPortable);
+        cudaEventCreateWithFlags(&buffers.copied[k], cudaEventDisableTiming);
+        buffers.claimed[k] = false;
+      }
+      buffers.next = 0;
+      return &buffers;
+    }
+    return &it->second;
+  }
+
+  // Waits until a slot is not claimed by another chunk and claims it. Its
+  // pinned buffer may still be read by the copy of its previous chunk,
+  // which "copied" tells (to be waited for after this returns).
+  int Claim(PerDevice* buffers) {
+    ::tensorflow::mutex_lock lock(mu_);
+    for (;;) {
+      for (int k = 0; k < kSlots; ++k) {
+        const int slot = (buffers->next + k) % kSlots;
+        if (!buffers->claimed[slot]) {
+          buffers->claimed[slot] = true;
+          buffers->next = (slot + 1) % kSlots;
+          return slot;
+        }
+      }
+      released_.wait(lock);
+    }
+  }
+
+  void Release(PerDevice* buffers, int slot) {
+    {
+      ::tensorflow::mutex_lock lock(mu_);
+      buffers->claimed[slot] = false;
+    }
+    released_.notify_one();
+  }
+
+ private:
+  HostStaging() {
+    TF_CHECK_OK(::tensorflow::ReadInt64FromEnvVar("MATRIX_ADD_HOST_CHUNK_BYTES",
+                                                  4 << 20, &chunk_bytes_));
+    // whole 1 KiB blocks, which keeps the vectorized loads of all chunks aligned
+    chunk_bytes_ = std::max<::tensorflow::int64>(1024, chunk_bytes_ / 1024 * 1024);
+  }
+
+  ::tensorflow::int64 chunk_bytes_;
+  ::tensorflow::mutex mu_;
+  ::tensorflow::condition_variable released_;
+  std::map<int, PerDevice> devices_;  // nodes are never moved nor erased
+};
+
+
+// true if the stream is recorded (e.g. into a CUDA graph), which does not
+// allow the synchronization the tuning needs
+inline bool IsCapturing(const ::tensorflow::GPUDevice& d) {
+#if CUDART_VERSION >= 10000
+  cudaStreamCaptureStatus status;
+  return cudaStreamIsCapturing(d.stream(), &status) != cudaSuccess ||
+         status != cudaStreamCaptureStatusNone;
+#else
+  return false;
+#endif
+}
+
+
+template<Activation A>
+using LaunchForwardBroadcast =
+    ::tensorflow::functor::elementwise::Launch<BinaryAdd>::ForwardBroadcast<A>;
+
+
+template<Activation A>
+struct LaunchForwardBias {
+  template<typename T>
+  static void Run(const ::tensorflow::GPUDevice& d, T* top, const int N,
+                  const T* matrixA, const T* matrixB, const T* bias, const int channels,
+                  const float scale, const float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b) {
+    MATRIX_ADD_NVTX_RANGE("forward_bias");
+    LaunchConfig cfg = GetLaunchConfig(N, d);
+    forward_bias<T, A>
+    <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+      top, N, matrixA, matrixB, bias, channels, scale, alpha, index_a, index_b);
+  }
+};
+
+
+template<Activation A>
+struct LaunchBackwardActivationBias {
+  template<typename T>
+  static void Run(const ::tensorflow::GPUDevice& d, const T* top_diff, const int N,
+                  const T* top, const T* matrixA, const T* matrixB,
+                  const T* bias, const int channels, const float scale, const float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b,
+                  T* grad, T* grad_sum) {
+    MATRIX_ADD_NVTX_RANGE("backward_activation_bias");
+    LaunchConfig cfg = GetLaunchConfig(N, d);
+    backward_activation_bias<T, A>
+    <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+      top_diff, N, top, matrixA, matrixB, bias, channels, scale, alpha, index_a, index_b,
+      grad, grad_sum);
+  }
+};
+
+
+template<Activation A>
+struct LaunchBackwardActivation {
+  template<typename T>
+  static void Run(const ::tensorflow::GPUDevice& d, const T* top_diff, const int N,
+                  const T* top, const T* matrixA, const T* matrixB,
+                  const T bias, const float scale, const float alpha,
+                  const BroadcastIndex& index_a, const BroadcastIndex& index_b,
+                  T* grad) {
+    MATRIX_ADD_NVTX_RANGE("backward_activation");
+    LaunchConfig cfg = GetLaunchConfig(N, d);
+    backward_activation<T, A>
+    <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+      top_diff, N, top, matrixA, matrixB, bias, scale, alpha, index_a, index_b, grad);
+  }
+};
+
+
+template<Activation A>
+struct LaunchBackwardActivationSparse {
+  template<typename T, typename Index>
+  static void Run(const ::tensorflow::GPUDevice& d, const T* values, const Index* indices,
+                  const int K, const int row_size, const int rows,
+                  const T* top, const T* matrixA, const T* matrixB,
+                  const T bias, const float scale, const float alpha, T* grad) {
+    MATRIX_ADD_NVTX_RANGE("backward_activation_sparse");
+    LaunchConfig cfg = GetLaunchConfig(K * row_size, d);
+    backward_activation_sparse<T, Index, A>
+    <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+      values, indices, K, row_size, rows, top, matrixA, matrixB, bias, scale, alpha, grad);
+  }
+};
 
+
+// pointers to the inputs of a single pass of "forward_n", passed by value
 template<typename T>
-__global__ void forward(CudaLaunchConfig cfg,
-                        T* top,
-                        const int N,
-                        const T* matrixA,
-                        const T* matrixB,
-                        const T bias) {
-  // for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
-  CUDA_1D_KERNEL_LOOP(i, cfg.virtual_thread_count) {
-    top[i] = matrixA[i] + matrixB[i] + (T) bias;
+struct InputPointers {
+  enum { kMax = 8 };
+  const T* ptr[kMax];
+  int count;
+};
+
+
+// top = (accumulate ? top : bias) + sum of all inputs
+template<typename T>
+__global__ void forward_n(T* top,
+                          const int N,
+                          const InputPointers<T> inputs,
+                          const T bias,
+                          const bool accumulate) {
+  typedef typename AccumulatorType<T>::type Acc;
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    Acc sum = accumulate ? Acc(top[i]) : Acc(bias);
+    for (int k = 0; k < inputs.count; ++k)
+      sum += Acc(inputs.ptr[k][i]);
+    top[i] = static_cast<T>(sum);
+  }
+}
+
+
+// same as "forward_n" but with 128-bit loads and stores,
+// requires all buffers to be aligned to 16 bytes
+template<typename T>
+__global__ void forward_n_vectorized(T* top,
+                                     const int N,
+                                     const InputPointers<T> inputs,
+                                     const T bias,
+                                     const bool accumulate) {
+  typedef typename Vectorized<T>::type V;
+  typedef typename AccumulatorType<T>::type Acc;
+  constexpr int kSize = Vectorized<T>::size;
+
+  const int N_vec = N / kSize;
+  V* top_vec = reinterpret_cast<V*>(top);
+
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N_vec; i += blockDim.x * gridDim.x) {
+    Acc sum[kSize];
+    if (accumulate) {
+      const V c = top_vec[i];
+      const T* c_ = reinterpret_cast<const T*>(&c);
+#pragma unroll
+      for (int j = 0; j < kSize; ++j)
+        sum[j] = Acc(c_[j]);
+    } else {
+#pragma unroll
+      for (int j = 0; j < kSize; ++j)
+        sum[j] = Acc(bias);
+    }
+
+    for (int k = 0; k < inputs.count; ++k) {
+      const V a = LoadReadOnly(reinterpret_cast<const V*>(inputs.ptr[k]) + i);
+      const T* a_ = reinterpret_cast<const T*>(&a);
+#pragma unroll
+      for (int j = 0; j < kSize; ++j)
+        sum[j] += Acc(a_[j]);
+    }
+
+    V c;
+    T* c_ = reinterpret_cast<T*>(&c);
+#pragma unroll
+    for (int j = 0; j < kSize; ++j)
+      c_[j] = static_cast<T>(sum[j]);
+    top_vec[i] = c;
+  }
+
+  // scalar tail (less than "kSize" elements)
+  const int i = N_vec * kSize + blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N) {
+    Acc sum = accumulate ? Acc(top[i]) : Acc(bias);
+    for (int k = 0; k < inputs.count; ++k)
+      sum += Acc(inputs.ptr[k][i]);
+    top[i] = static_cast<T>(sum);
+  }
+}
+
+
+// pointers and sizes of the groups of a single pass of "forward_grouped",
+// passed by value as kernel argument (no extra host-to-device copy)
+template<typename T>
+struct GroupDescriptors {
+  enum { kMax = 32 };
+  const T* matrixA[kMax];
+  const T* matrixB[kMax];
+  T* top[kMax];
+  int size[kMax];
+};
+
+
+// "forward" over several independent groups, "blockIdx.y" is the group
+template<typename T>
+__global__ void forward_grouped(const GroupDescriptors<T> groups,
+                                const T bias) {
+  const int g = blockIdx.y;
+  const T* matrixA = groups.matrixA[g];
+  const T* matrixB = groups.matrixB[g];
+  T* top = groups.top[g];
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < groups.size[g]; i += blockDim.x * gridDim.x) {
+    top[i] = AddActivate<Activation::kNone>(LoadReadOnly(matrixA + i), LoadReadOnly(matrixB + i),
+                                            bias, 1.f, 0.f);
   }
 }
 
@@ -40,39 +601,741 @@ __global__ void backward(CudaLaunchConfig cfg,
   }
 }
 
+// one thread per gradient entry, used for short reductions
+template<typename T>
+__global__ void backward_reduce(const T* top_diff,
+                                const int N,
+                                T* grad,
+                                const ::tensorflow::functor::BroadcastReduction reduction) {
+  typedef typename AccumulatorType<T>::type Acc;
+  for (int g = blockIdx.x * blockDim.x + threadIdx.x; g < N; g += blockDim.x * gridDim.x) {
+    const T* src = top_diff + reduction.kept(g);
+    Acc sum = Acc(0);
+    for (int r = 0; r < reduction.reduce_size; ++r)
+      sum += Acc(src[reduction.reduced(r)]);
+    grad[g] = static_cast<T>(sum);
+  }
+}
+
+
+// one block per gradient entry, used for long reductions
+// (e.g. the gradient of a per-channel [1, 1, 1, D] input)
+template<typename T, int kThreads>
+__global__ void backward_reduce_block(const T* top_diff,
+                                      const int N,
+                                      T* grad,
+                                      const ::tensorflow::functor::BroadcastReduction reduction) {
+  typedef typename AccumulatorType<T>::type Acc;
+  __shared__ Acc partial[kThreads];
+
+  for (int g = blockIdx.x; g < N; g += gridDim.x) {
+    const T* src = top_diff + reduction.kept(g);
+    Acc sum = Acc(0);
+    for (int r = threadIdx.x; r < reduction.reduce_size; r += kThreads)
+      sum += Acc(src[reduction.reduced(r)]);
+    partial[threadIdx.x] = sum;
+    __syncthreads();
+
+    // tree reduction in a fixed order, hence deterministic
+#pragma unroll
+    for (int offset = kThreads / 2; offset > 0; offset /= 2) {
+      if (threadIdx.x < offset)
+        partial[threadIdx.x] += partial[threadIdx.x + offset];
+      __syncthreads();
+    }
+
+    if (threadIdx.x == 0)
+      grad[g] = static_cast<T>(partial[0]);
+    __syncthreads();
+  }
+}
+
+// quantized sum (see "QuantizedAddParams"), the 8-bit values are processed
+// in 32-bit lanes (aligned buffers use "forward_quantized_packed")
+template<typename S>
+__global__ void forward_quantized(S* top,
+                                  const int N,
+                                  const S* matrixA,
+                                  const S* matrixB,
+                                  const QuantizedAddParams params) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    top[i] = params(LoadReadOnly(matrixA + i), LoadReadOnly(matrixB + i));
+  }
+}
+
+
+// "QuantizedAddParams" for "forward_quantized_packed". The 32-bit
+// multipliers (below 2^22) are split into 15-bit halves,
+//
+//   x * multiplier = ((x * hi) << 15) + x * lo,
+//
+// with the halves of "a" in the low and those of "b" in the high 16 bits of
+// "hi" and "lo", and the "+ zero" of the signed type is folded into
+// "offset". The packed lanes therefore compute the same 32-bit sums as
+// "QuantizedAddParams" and give the same outputs.
+struct PackedQuantizedAddParams {
+  int hi;
+  int lo;
+  int offset;
+  int shift;
+  int lowest;
+  int highest;
+};
+
+template<typename S>
+PackedQuantizedAddParams MakePackedQuantizedAddParams(const QuantizedAddParams& params) {
+  const int zero = static_cast<S>(-1) < 0 ? 128 : 0;
+  PackedQuantizedAddParams packed;
+  packed.hi = (params.multiplier_b >> 15) << 16 | (params.multiplier_a >> 15);
+  packed.lo = (params.multiplier_b & 0x7fff) << 16 | (params.multiplier_a & 0x7fff);
+  packed.offset = params.offset + zero * (params.multiplier_a + params.multiplier_b);
+  packed.shift = params.shift;
+  packed.lowest = params.lowest;
+  packed.highest = params.highest;
+  return packed;
+}
+
+// "a * m.lo16 + b * m.hi16 + c" of the values "a" and "b" in the bytes 0, 1
+// (Lo) or 2, 3 (Hi) of "ab", signed for "qint8" and unsigned for "quint8".
+// A single "__dp2a" from sm_61 on, the other architectures of the fatbin
+// compute the same in 32-bit lanes.
+template<typename S>
+struct PackedDot;
+
+template<>
+struct PackedDot<signed char> {
+  __device__ __forceinline__ static int Lo(unsigned int ab, int m, int c) {
+#if __CUDA_ARCH__ >= 610
+    return __dp2a_lo(m, static_cast<int>(ab), c);
+#else
+    return static_cast<signed char>(ab) * static_cast<short>(m) +
+           static_cast<signed char>(ab >> 8) * (m >> 16) + c;
+#endif
+  }
+
+  __device__ __forceinline__ static int Hi(unsigned int ab, int m, int c) {
+#if __CUDA_ARCH__ >= 610
+    return __dp2a_hi(m, static_cast<int>(ab), c);
+#else
+    return Lo(ab >> 16, m, c);
+#endif
+  }
+};
+
+template<>
+struct PackedDot<unsigned char> {
+  // the halves of the multipliers are positive 15-bit values and the
+  // partial sums fit into 31 bits, so the unsigned sum has the signed bits
+  __device__ __forceinline__ static int Lo(unsigned int ab, int m, int c) {
+#if __CUDA_ARCH__ >= 610
+    return static_cast<int>(__dp2a_lo(static_cast<unsigned int>(m), ab, static_cast<unsigned int>(c)));
+#else
+    return static_cast<int>(ab & 0xff) * (m & 0xffff) +
+           static_cast<int>((ab >> 8) & 0xff) * (m >> 16) + c;
+#endif
+  }
+
+  __device__ __forceinline__ static int Hi(unsigned int ab, int m, int c) {
+#if __CUDA_ARCH__ >= 610
+    return static_cast<int>(__dp2a_hi(static_cast<unsigned int>(m), ab, static_cast<unsigned int>(c)));
+#else
+    return Lo(ab >> 16, m, c);
+#endif
+  }
+};
+
+// output byte of the partial sums "hi" and "lo" of one value. The sum is
+// formed in unsigned arithmetic, "hi << 15" alone may exceed 31 bits while
+// the whole sum does not.
+__device__ __forceinline__ unsigned int PackedValue(int hi, int lo,
+                                                    const PackedQuantizedAddParams& params) {
+  int q = static_cast<int>((static_cast<unsigned int>(hi) << 15) + static_cast<unsigned int>(lo));
+  q >>= params.shift;
+  q = max(params.lowest, min(params.highest, q));
+  return static_cast<unsigned int>(q) & 0xff;
+}
+
+// output byte of the value in the bytes 0, 1 (Lo) or 2, 3 (Hi) of "ab"
+template<typename S>
+__device__ __forceinline__ unsigned int PackedValueLo(unsigned int ab,
+                                                      const PackedQuantizedAddParams& params) {
+  return PackedValue(PackedDot<S>::Lo(ab, params.hi, 0),
+                     PackedDot<S>::Lo(ab, params.lo, params.offset), params);
+}
+
+template<typename S>
+__device__ __forceinline__ unsigned int PackedValueHi(unsigned int ab,
+                                                      const PackedQuantizedAddParams& params) {
+  return PackedValue(PackedDot<S>::Hi(ab, params.hi, 0),
+                     PackedDot<S>::Hi(ab, params.lo, params.offset), params);
+}
+
+// quantized sum of the four values of the words "a" and "b", bytes 0..3 are
+// interleaved to "a0 b0 a1 b1" and "a2 b2 a3 b3"
+template<typename S>
+__device__ __forceinline__ unsigned int PackedQuantizedAdd(unsigned int a, unsigned int b,
+                                                           const PackedQuantizedAddParams& params) {
+  const unsigned int lo = __byte_perm(a, b, 0x5140);
+  const unsigned int hi = __byte_perm(a, b, 0x7362);
+  return PackedValueLo<S>(lo, params) |
+         PackedValueHi<S>(lo, params) << 8 |
+         PackedValueLo<S>(hi, params) << 16 |
+         PackedValueHi<S>(hi, params) << 24;
+}
+
+// same as "forward_quantized" with 16 values per 128-bit load and store,
+// requires all buffers to be aligned to 16 bytes. Each value takes two
+// "__dp2a" on interleaved bytes instead of being unpacked into a 32-bit lane.
+template<typename S>
+__global__ void forward_quantized_packed(S* top,
+                                         const int N,
+                                         const S* matrixA,
+                                         const S* matrixB,
+                                         const PackedQuantizedAddParams params) {
+  constexpr int kSize = sizeof(uint4) / sizeof(S);
+
+  const int N_vec = N / kSize;
+  const uint4* matrixA_vec = reinterpret_cast<const uint4*>(matrixA);
+  const uint4* matrixB_vec = reinterpret_cast<const uint4*>(matrixB);
+  uint4* top_vec = reinterpret_cast<uint4*>(top);
+
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N_vec; i += blockDim.x * gridDim.x) {
+    const uint4 a = LoadReadOnly(matrixA_vec + i);
+    const uint4 b = LoadReadOnly(matrixB_vec + i);
+    uint4 c;
+    c.x = PackedQuantizedAdd<S>(a.x, b.x, params);
+    c.y = PackedQuantizedAdd<S>(a.y, b.y, params);
+    c.z = PackedQuantizedAdd<S>(a.z, b.z, params);
+    c.w = PackedQuantizedAdd<S>(a.w, b.w, params);
+    top_vec[i] = c;
+  }
+
+  // scalar tail (less than "kSize" elements)
+  const int i = N_vec * kSize + blockIdx.x * blockDim.x + threadIdx.x;
+  if (i < N) {
+    const unsigned int ab = static_cast<unsigned char>(LoadReadOnly(matrixA + i)) |
+                            static_cast<unsigned int>(static_cast<unsigned char>(LoadReadOnly(matrixB + i))) << 8;
+    top[i] = static_cast<S>(PackedValueLo<S>(ab, params));
+  }
+}
+
+
+template<typename S>
+__global__ void forward_quantized_broadcast(S* top,
+                                            const int N,
+                                            const S* matrixA,
+                                            const S* matrixB,
+                                            const QuantizedAddParams params,
+                                            const BroadcastIndex index_a,
+                                            const BroadcastIndex index_b) {
+  for (int i = blockIdx.x * blockDim.x + threadIdx.x; i < N; i += blockDim.x * gridDim.x) {
+    top[i] = params(LoadReadOnly(matrixA + index_a(i)), LoadReadOnly(matrixB + index_b(i)));
+  }
+}
+
 } // anonymous namespace
 
 
 namespace tensorflow {
 namespace functor {
 
+// All functors below only enqueue work on the stream of the op ("d.stream()"):
+// kernel launches and "d.memcpy" (cudaMemcpyAsync). They never touch the
+// legacy default stream, never synchronize with the host and never allocate
+// memory, so they can be recorded by stream capture (e.g. into a CUDA graph)
+// and replayed. Keep it that way, launch parameters may only depend on the
+// shapes and on device properties which Eigen caches at construction.
+//
+// The only exceptions are in "MatrixAddFunctor": its first call for a new
+// (device, dtype, activation, size-bucket) autotunes the launch parameters
+// (see "ForwardAutotuneMap") and, if enabled, the chunked forward pass
+// creates its side streams on first use (see "SideStreams"). Both are
+// skipped for captured streams. "MatrixAddHostFunctor" (kernel label
+// "host_a") waits for its staging buffers on the host and is never
+// capture-safe.
+//
+// test_matrix_add_capture.cu captures MatrixAdd, MatrixAddGrad and
+// MatrixAddN into a CUDA graph and checks the replayed outputs (CUDA 10+).
+
 template <typename Dtype>
 struct MatrixAddFunctor<GPUDevice, Dtype> {
   void operator ()(::tensorflow::OpKernelContext* ctx,
                    const Tensor& mA_,
                    const Tensor& mB_,
                    Tensor *mC_,
-                   Dtype bias) {
+                   Dtype bias,
+                   const Epilogue& epilogue) {
     const int N = mA_.NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
 
-    ::tensorflow::CudaLaunchConfig cfg =
-      ::tensorflow::GetCudaLaunchConfig(N, ctx->eigen_device<GPUDevice>());
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
 
-    forward<Dtype>
-    <<< cfg.block_count, cfg.thread_per_block, 0, ctx->eigen_gpu_device().stream() >>> (
-      cfg,
-      mC_->flat<Dtype>().data(),
-      mA_.NumElements(),
-      mA_.flat<Dtype>().data(),
-      mB_.flat<Dtype>().data(),
-      bias);
+    ForwardAutotuneMap* autotune = ForwardAutotuneMap::Global();
 
+    typedef Vectorized<Dtype> V;
+    const bool aligned = autotune->vectorize() &&
+                         V::aligned(mA) && V::aligned(mB) && V::aligned(mC);
+    ForwardParams params = {256, aligned};
+
+    if (autotune->enabled()) {
+      // sizes are bucketed by powers of two
+      int bucket = 0;
+      while ((1 << (bucket + 1)) <= N && bucket < 30)
+        ++bucket;
+      const string key = strings::StrCat(
+          "sm_", d.majorDeviceVersion(), d.minorDeviceVersion(),
+          "x", d.getNumCudaMultiProcessors(), "/", DataTypeString(DataTypeToEnum<Dtype>::value),
+          "/", static_cast<int>(epilogue.activation), "/", bucket, "/", aligned);
+
+      Tensor scratch;
+      // the tuning synchronizes with the host, which is only done once per
+      // key and never while the stream is captured
+      if (!autotune->Find(key, &params) && !IsCapturing(d) &&
+          ctx->allocate_temp(DataTypeToEnum<Dtype>::value, TensorShape({N}), &scratch).ok()) {
+        DispatchActivation<TuneForward>(epilogue.activation,
+          d, aligned, &params, scratch.flat<Dtype>().data(), N, mA, mB, bias,
+          epilogue.scale, epilogue.alpha);
+        autotune->Insert(key, params);
+      }
+      // the entries of MATRIX_ADD_AUTOTUNE_FILE may come from another
+      // process (or device), neither the alignment nor the block size of
+      // this launch are implied by them
+      params.vectorized = params.vectorized && aligned;
+      params.thread_per_block = std::min(params.thread_per_block, d.maxCudaThreadsPerBlock());
+    }
+
+    SideStreams* side_streams = SideStreams::Global();
+    if (side_streams->Split(N * sizeof(Dtype)) && !IsCapturing(d)) {
+      // chunks start at multiples of 256 elements, which keeps the
+      // vectorized loads aligned
+      const int chunks = side_streams->num_streams();
+      const int chunk = (N / chunks + 255) / 256 * 256;
+      side_streams->Run(d.stream(), [&](cudaStream_t stream, int k) {
+        const int begin = std::min(N, k * chunk);
+        const int end = std::min(N, begin + chunk);
+        if (begin < end)
+          DispatchActivation<LaunchForward>(epilogue.activation,
+            d, stream, params, mC + begin, end - begin, mA + begin, mB + begin,
+            bias, epilogue.scale, epilogue.alpha);
+      });
+      return;
+    }
+
+    DispatchActivation<LaunchForward>(epilogue.activation,
+      d,
+      d.stream(),
+      params,
+      mC,
+      N,
+      mA,
+      mB,
+      bias,
+      epilogue.scale,
+      epilogue.alpha);
   }
 };
 
 template struct MatrixAddFunctor<GPUDevice, int>;
 template struct MatrixAddFunctor<GPUDevice, float>;
 template struct MatrixAddFunctor<GPUDevice, double>;
+template struct MatrixAddFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddFunctor<GPUDevice, bfloat16>;
+
+
+// Chunk "i" of "mA_" is copied by the host into a pinned buffer, then by
+// the copy stream into a device buffer, and finally read by the kernel on
+// the op stream, such that the copy of chunk "i + 1" overlaps with the
+// kernel of chunk "i". A pinned buffer is only refilled when the copy out
+// of it is done, and a device buffer of the ring of the op only when the
+// kernel of its last chunk is done. The host waits for the pinned buffer
+// after its slot is claimed, so other ops keep staging their chunks.
+//
+// This synchronizes with the host and is hence not capture-safe, the host
+// input is not needed anymore once the functor returns.
+template <typename Dtype>
+struct MatrixAddHostFunctor<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue) {
+    const int N = mC_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    HostStaging* staging = HostStaging::Global();
+    const int chunk = staging->chunk_bytes() / sizeof(Dtype);
+    const int stride = std::min(chunk, (N + 255) / 256 * 256);
+
+    Tensor ring;
+    OP_REQUIRES_OK(ctx, ctx->allocate_temp(DataTypeToEnum<Dtype>::value,
+                   TensorShape({HostStaging::kSlots * stride}), &ring));
+
+    const Dtype* mA = mA_.flat<Dtype>().data();
+    const Dtype* mB = mB_.flat<Dtype>().data();
+    Dtype* mC = mC_->flat<Dtype>().data();
+    Dtype* staged = ring.flat<Dtype>().data();
+
+    typedef Vectorized<Dtype> V;
+    const bool aligned = ForwardAutotuneMap::Global()->vectorize() &&
+                         V::aligned(mB) && V::aligned(mC) && V::aligned(staged);
+    const ForwardParams params = {256, aligned};
+
+    // the kernel of the last chunk of each device buffer is done
+    cudaEvent_t consumed[HostStaging::kSlots];
+    for (int k = 0; k < HostStaging::kSlots; ++k)
+      cudaEventCreateWithFlags(&consumed[k], cudaEventDisableTiming);
+
+    HostStaging::PerDevice* buffers = staging->Get();
+
+    // "ring" is only free on the op stream, e.g. its memory may have been
+    // the temp buffer of the previous op still running there, hence the
+    // copies wait for the work enqueued so far (like "SideStreams::Run")
+    cudaEvent_t fork;
+    cudaEventCreateWithFlags(&fork, cudaEventDisableTiming);
+    cudaEventRecord(fork, d.stream());
+    cudaStreamWaitEvent(buffers->copy_stream, fork, 0);
+
+    for (int begin = 0, i = 0; begin < N; begin += chunk, ++i) {
+      const int size = std::min(chunk, N - begin);
+      const int ring_slot = i % HostStaging::kSlots;
+      Dtype* device = staged + ring_slot * stride;
+
+      const int slot = staging->Claim(buffers);
+      Dtype* pinned = static_cast<Dtype*>(buffers->pinned[slot]);
+      cudaEventSynchronize(buffers->copied[slot]);
+      std::memcpy(pinned, mA + begin, size * sizeof(Dtype));
+
+      if (i >= HostStaging::kSlots)
+        cudaStreamWaitEvent(buffers->copy_stream, consumed[ring_slot], 0);
+      {
+        MATRIX_ADD_NVTX_RANGE("copy_host_to_device");
+        cudaMemcpyAsync(device, pinned, size * sizeof(Dtype),
+                        cudaMemcpyHostToDevice, buffers->copy_stream);
+      }
+      cudaEventRecord(buffers->copied[slot], buffers->copy_stream);
+      // before the release, later chunks of other ops record "copied" again
+      cudaStreamWaitEvent(d.stream(), buffers->copied[slot], 0);
+      staging->Release(buffers, slot);
+
+      DispatchActivation<LaunchForward>(epilogue.activation,
+        d, d.stream(), params, mC + begin, size, device, mB + begin,
+        bias, epilogue.scale, epilogue.alpha);
+      cudaEventRecord(consumed[ring_slot], d.stream());
+    }
+
+    // the resources are released once the recorded work is done
+    cudaEventDestroy(fork);
+    for (int k = 0; k < HostStaging::kSlots; ++k)
+      cudaEventDestroy(consumed[k]);
+  }
+};
+
+template struct MatrixAddHostFunctor<GPUDevice, int>;
+template struct MatrixAddHostFunctor<GPUDevice, float>;
+template struct MatrixAddHostFunctor<GPUDevice, double>;
+template struct MatrixAddHostFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddHostFunctor<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBroadcastFunctor<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const int N = mC_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    DispatchActivation<LaunchForwardBroadcast>(epilogue.activation,
+      d,
+      mC_->flat<Dtype>().data(),
+      N,
+      mA_.flat<Dtype>().data(),
+      mB_.flat<Dtype>().data(),
+      bias,
+      epilogue.scale,
+      epilogue.alpha,
+      index_a,
+      index_b);
+  }
+};
+
+template struct MatrixAddBroadcastFunctor<GPUDevice, int>;
+template struct MatrixAddBroadcastFunctor<GPUDevice, float>;
+template struct MatrixAddBroadcastFunctor<GPUDevice, double>;
+template struct MatrixAddBroadcastFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddBroadcastFunctor<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBiasFunctor<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   Tensor *mC_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const int N = mC_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    DispatchActivation<LaunchForwardBias>(epilogue.activation,
+      d,
+      mC_->flat<Dtype>().data(),
+      N,
+      mA_.flat<Dtype>().data(),
+      mB_.flat<Dtype>().data(),
+      bias_.flat<Dtype>().data(),
+      static_cast<int>(bias_.NumElements()),
+      epilogue.scale,
+      epilogue.alpha,
+      index_a,
+      index_b);
+  }
+};
+
+template struct MatrixAddBiasFunctor<GPUDevice, int>;
+template struct MatrixAddBiasFunctor<GPUDevice, float>;
+template struct MatrixAddBiasFunctor<GPUDevice, double>;
+template struct MatrixAddBiasFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddBiasFunctor<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddActivationGrad<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_) {
+    const int N = grad_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    DispatchActivation<LaunchBackwardActivation>(epilogue.activation,
+      d,
+      topdiff_.flat<Dtype>().data(),
+      N,
+      output_.flat<Dtype>().data(),
+      mA_.flat<Dtype>().data(),
+      mB_.flat<Dtype>().data(),
+      bias,
+      epilogue.scale,
+      epilogue.alpha,
+      index_a,
+      index_b,
+      grad_->flat<Dtype>().data());
+  }
+};
+
+template struct MatrixAddActivationGrad<GPUDevice, int>;
+template struct MatrixAddActivationGrad<GPUDevice, float>;
+template struct MatrixAddActivationGrad<GPUDevice, double>;
+template struct MatrixAddActivationGrad<GPUDevice, Eigen::half>;
+template struct MatrixAddActivationGrad<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddBiasActivationGrad<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_,
+                   Tensor *grad_sum_) {
+    const int N = grad_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    DispatchActivation<LaunchBackwardActivationBias>(epilogue.activation,
+      d,
+      topdiff_.flat<Dtype>().data(),
+      N,
+      output_.flat<Dtype>().data(),
+      mA_.flat<Dtype>().data(),
+      mB_.flat<Dtype>().data(),
+      bias_.flat<Dtype>().data(),
+      static_cast<int>(bias_.NumElements()),
+      epilogue.scale,
+      epilogue.alpha,
+      index_a,
+      index_b,
+      grad_->flat<Dtype>().data(),
+      grad_sum_ == nullptr ? nullptr : grad_sum_->flat<Dtype>().data());
+  }
+};
+
+template struct MatrixAddBiasActivationGrad<GPUDevice, int>;
+template struct MatrixAddBiasActivationGrad<GPUDevice, float>;
+template struct MatrixAddBiasActivationGrad<GPUDevice, double>;
+template struct MatrixAddBiasActivationGrad<GPUDevice, Eigen::half>;
+template struct MatrixAddBiasActivationGrad<GPUDevice, bfloat16>;
+
+
+template <typename Dtype, typename Index>
+struct MatrixAddSparseActivationGrad<GPUDevice, Dtype, Index> {
+  int64 operator ()(::tensorflow::OpKernelContext* ctx,
+                    const Tensor& values_,
+                    const Tensor& indices_,
+                    const Tensor& output_,
+                    const Tensor& mA_,
+                    const Tensor& mB_,
+                    Dtype bias,
+                    const Epilogue& epilogue,
+                    Tensor *grad_) {
+    const int K = indices_.NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (K == 0 || values_.NumElements() == 0)
+      return -1;
+
+    DispatchActivation<LaunchBackwardActivationSparse>(epilogue.activation,
+      d,
+      values_.flat<Dtype>().data(),
+      indices_.flat<Index>().data(),
+      K,
+      static_cast<int>(values_.NumElements() / K),
+      static_cast<int>(output_.dim_size(0)),
+      output_.flat<Dtype>().data(),
+      mA_.flat<Dtype>().data(),
+      mB_.flat<Dtype>().data(),
+      bias,
+      epilogue.scale,
+      epilogue.alpha,
+      grad_->flat<Dtype>().data());
+    return -1;
+  }
+};
+
+template struct MatrixAddSparseActivationGrad<GPUDevice, float, int32>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, float, int64>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, double, int32>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, double, int64>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, Eigen::half, int32>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, Eigen::half, int64>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, bfloat16, int32>;
+template struct MatrixAddSparseActivationGrad<GPUDevice, bfloat16, int64>;
+
+
+template <typename Dtype>
+struct MatrixAddNFunctor<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& inputs,
+                   Tensor *mC_,
+                   Dtype bias) {
+    const int N = mC_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    Dtype* mC = mC_->flat<Dtype>().data();
+
+    typedef Vectorized<Dtype> V;
+    bool aligned = V::aligned(mC);
+    for (const Tensor* input : inputs)
+      aligned &= V::aligned(input->flat<Dtype>().data());
+
+    MATRIX_ADD_NVTX_RANGE(aligned ? "forward_n_vectorized" : "forward_n");
+    LaunchConfig cfg = GetLaunchConfig(aligned ? N / V::size : N, d);
+
+    // usually all inputs fit into the kernel arguments of a single launch,
+    // otherwise every further launch accumulates the next few inputs
+    const int K = inputs.size();
+    for (int first = 0; first < K; first += InputPointers<Dtype>::kMax) {
+      InputPointers<Dtype> ptrs;
+      ptrs.count = std::min<int>(InputPointers<Dtype>::kMax, K - first);
+      for (int k = 0; k < ptrs.count; ++k)
+        ptrs.ptr[k] = inputs[first + k]->flat<Dtype>().data();
+
+      if (aligned) {
+        forward_n_vectorized<Dtype>
+        <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+          mC, N, ptrs, bias, first > 0);
+      } else {
+        forward_n<Dtype>
+        <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+          mC, N, ptrs, bias, first > 0);
+      }
+    }
+  }
+};
+
+template struct MatrixAddNFunctor<GPUDevice, int>;
+template struct MatrixAddNFunctor<GPUDevice, float>;
+template struct MatrixAddNFunctor<GPUDevice, double>;
+template struct MatrixAddNFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddNFunctor<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddGroupedFunctor<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& mA_,
+                   const std::vector<const Tensor*>& mB_,
+                   const std::vector<Tensor*>& mC_,
+                   Dtype bias) {
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    MATRIX_ADD_NVTX_RANGE("forward_grouped");
+
+    // one launch per "kMax" groups, every group gets its own row of blocks
+    // sized for the largest group of the pass
+    const int K = mC_.size();
+    for (int first = 0; first < K; first += GroupDescriptors<Dtype>::kMax) {
+      GroupDescriptors<Dtype> groups;
+      const int count = std::min<int>(GroupDescriptors<Dtype>::kMax, K - first);
+      int max_size = 0;
+      for (int k = 0; k < count; ++k) {
+        groups.matrixA[k] = mA_[first + k]->flat<Dtype>().data();
+        groups.matrixB[k] = mB_[first + k]->flat<Dtype>().data();
+        groups.top[k] = mC_[first + k]->flat<Dtype>().data();
+        groups.size[k] = mC_[first + k]->NumElements();
+        max_size = std::max(max_size, groups.size[k]);
+      }
+      if (max_size == 0)
+        continue;
+
+      LaunchConfig cfg = GetLaunchConfig(max_size, d);
+      // the resident blocks are shared by all groups of the pass
+      const dim3 grid(std::max(1, cfg.block_count / count), count);
+      forward_grouped<Dtype>
+      <<< grid, cfg.thread_per_block, 0, d.stream() >>> (
+        groups, bias);
+    }
+  }
+};
+
+template struct MatrixAddGroupedFunctor<GPUDevice, int>;
+template struct MatrixAddGroupedFunctor<GPUDevice, float>;
+template struct MatrixAddGroupedFunctor<GPUDevice, double>;
+template struct MatrixAddGroupedFunctor<GPUDevice, Eigen::half>;
+template struct MatrixAddGroupedFunctor<GPUDevice, bfloat16>;
 
 
 template <typename Dtype>
@@ -83,32 +1346,176 @@ struct MatrixAddGrad<GPUDevice, Dtype> {
                    Tensor *grad_mB_) {
 
     const int N = topdiff_.NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
 
-    ::tensorflow::CudaLaunchConfig cfg =
-      ::tensorflow::GetCudaLaunchConfig(N, ctx->eigen_device<GPUDevice>());
-
-    // // optional reset gradients before running a kernel
-    // cudaMemset(grad_mA_->flat<Dtype>().data(), 0, N * sizeof(Dtype));
-    // cudaMemset(grad_mB_->flat<Dtype>().data(), 0, N * sizeof(Dtype));
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+    Dtype* grad_mA = grad_mA_->flat<Dtype>().data();
+    Dtype* grad_mB = grad_mB_->flat<Dtype>().data();
 
-    // backward<Dtype>
-    // <<< cfg.block_count, cfg.thread_per_block, 0, ctx->eigen_gpu_device().stream() >>> (
-    //   cfg,
-    //   topdiff_.flat<Dtype>().data(),
-    //   topdiff_.NumElements(),
-    //   grad_mA_->flat<Dtype>().data(),
-    //   grad_mB_->flat<Dtype>().data());
+    // outputs might share the buffer of "topdiff" (forwarded input)
+    const bool copy_mA = grad_mA != topdiff;
+    const bool copy_mB = grad_mB != topdiff;
 
-    // faster alternative to custom kernel (above)
-    cudaMemcpy(grad_mA_->flat<Dtype>().data(), topdiff_.flat<Dtype>().data(), N * sizeof(Dtype), cudaMemcpyDeviceToDevice);
-    cudaMemcpy(grad_mB_->flat<Dtype>().data(), topdiff_.flat<Dtype>().data(), N * sizeof(Dtype), cudaMemcpyDeviceToDevice);
+    // everything below is enqueued on the stream of the op and never
+    // blocks the host thread
+    if (copy_mA && copy_mB) {
+      // read "topdiff" once and write both gradients
+      MATRIX_ADD_NVTX_RANGE("backward");
+      ::tensorflow::CudaLaunchConfig cfg =
+        ::tensorflow::GetCudaLaunchConfig(N, d);
 
+      backward<Dtype>
+      <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+        cfg,
+        topdiff,
+        N,
+        grad_mA,
+        grad_mB);
+    } else if (copy_mA) {
+      d.memcpy(grad_mA, topdiff, N * sizeof(Dtype));
+    } else if (copy_mB) {
+      d.memcpy(grad_mB, topdiff, N * sizeof(Dtype));
+    }
   }
 };
 
 template struct MatrixAddGrad<GPUDevice, int>;
 template struct MatrixAddGrad<GPUDevice, float>;
 template struct MatrixAddGrad<GPUDevice, double>;
+template struct MatrixAddGrad<GPUDevice, Eigen::half>;
+template struct MatrixAddGrad<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddNGrad<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const std::vector<Tensor*>& grads_) {
+    const int N = topdiff_.NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+
+    for (Tensor* grad_ : grads_) {
+      Dtype* grad = grad_->flat<Dtype>().data();
+      // outputs might share the buffer of "topdiff" (forwarded input)
+      if (grad != topdiff)
+        d.memcpy(grad, topdiff, N * sizeof(Dtype));
+    }
+  }
+};
+
+template struct MatrixAddNGrad<GPUDevice, int>;
+template struct MatrixAddNGrad<GPUDevice, float>;
+template struct MatrixAddNGrad<GPUDevice, double>;
+template struct MatrixAddNGrad<GPUDevice, Eigen::half>;
+template struct MatrixAddNGrad<GPUDevice, bfloat16>;
+
+
+template <typename Dtype>
+struct MatrixAddGradReduce<GPUDevice, Dtype> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   Tensor *grad_,
+                   const BroadcastReduction& reduction) {
+    const int N = grad_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    const Dtype* topdiff = topdiff_.flat<Dtype>().data();
+    Dtype* grad = grad_->flat<Dtype>().data();
+
+    constexpr int kThreads = 256;
+    if (reduction.reduce_size < kThreads) {
+      MATRIX_ADD_NVTX_RANGE("backward_reduce");
+      LaunchConfig cfg = GetLaunchConfig(N, d);
+      backward_reduce<Dtype>
+      <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+        topdiff, N, grad, reduction);
+    } else {
+      MATRIX_ADD_NVTX_RANGE("backward_reduce_block");
+      const int block_count = std::min(N,
+          d.getNumCudaMultiProcessors() * (d.maxCudaThreadsPerMultiProcessor() / kThreads));
+      backward_reduce_block<Dtype, kThreads>
+      <<< block_count, kThreads, 0, d.stream() >>> (
+        topdiff, N, grad, reduction);
+    }
+  }
+};
+
+template struct MatrixAddGradReduce<GPUDevice, int>;
+template struct MatrixAddGradReduce<GPUDevice, float>;
+template struct MatrixAddGradReduce<GPUDevice, double>;
+template struct MatrixAddGradReduce<GPUDevice, Eigen::half>;
+template struct MatrixAddGradReduce<GPUDevice, bfloat16>;
+
+
+template <typename T>
+struct QuantizedMatrixAddFunctor<GPUDevice, T> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params) {
+    const int N = mA_.NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    typedef typename QuantizedStorage<T>::type S;
+    const S* mA = reinterpret_cast<const S*>(mA_.flat<T>().data());
+    const S* mB = reinterpret_cast<const S*>(mB_.flat<T>().data());
+    S* mC = reinterpret_cast<S*>(mC_->flat<T>().data());
+
+    typedef Vectorized<int> V;
+    if (V::aligned(mA) && V::aligned(mB) && V::aligned(mC)) {
+      MATRIX_ADD_NVTX_RANGE("forward_quantized_packed");
+      LaunchConfig cfg = GetLaunchConfig(N / static_cast<int>(sizeof(uint4)), d);
+      forward_quantized_packed<S>
+      <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+        mC, N, mA, mB, MakePackedQuantizedAddParams<S>(params));
+    } else {
+      MATRIX_ADD_NVTX_RANGE("forward_quantized");
+      LaunchConfig cfg = GetLaunchConfig(N, d);
+      forward_quantized<S>
+      <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+        mC, N, mA, mB, params);
+    }
+  }
+};
+
+template struct QuantizedMatrixAddFunctor<GPUDevice, qint8>;
+template struct QuantizedMatrixAddFunctor<GPUDevice, quint8>;
+
+
+template <typename T>
+struct QuantizedMatrixAddBroadcastFunctor<GPUDevice, T> {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b) {
+    const int N = mC_->NumElements();
+    const GPUDevice& d = ctx->eigen_device<GPUDevice>();
+    if (N == 0)
+      return;
+
+    typedef typename QuantizedStorage<T>::type S;
+    MATRIX_ADD_NVTX_RANGE("forward_quantized_broadcast");
+    LaunchConfig cfg = GetLaunchConfig(N, d);
+    forward_quantized_broadcast<S>
+    <<< cfg.block_count, cfg.thread_per_block, 0, d.stream() >>> (
+      reinterpret_cast<S*>(mC_->flat<T>().data()), N,
+      reinterpret_cast<const S*>(mA_.flat<T>().data()),
+      reinterpret_cast<const S*>(mB_.flat<T>().data()),
+      params, index_a, index_b);
+  }
+};
+
+template struct QuantizedMatrixAddBroadcastFunctor<GPUDevice, qint8>;
+template struct QuantizedMatrixAddBroadcastFunctor<GPUDevice, quint8>;
 
 
 } // namespace functor
@@ -0,0 +1,110 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_MATRIX_ADD_NUMA_H_
+#define MATRIX_ADD_KERNELS_MATRIX_ADD_NUMA_H_
+
+#include <algorithm>
+
+#if MATRIX_ADD_NUMA
+#include <numa.h>
+#endif
+
+#include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+#include "tensorflow/core/util/env_var.h"
+
+namespace tensorflow {
+namespace functor {
+
+// NUMA-aware sharding of flat buffers, only available when built with
+// libnuma (see CMakeLists.txt) and enabled by MATRIX_ADD_NUMA_PIN=1.
+//
+// A buffer of "N" elements is split into one contiguous part per node. The
+// shards of a part are processed by threads which pin themselves to its
+// node while they run it (see "ScopedNumaPin"). Pages of fresh outputs are
+// hence first touched by that node, and the next op sharded the same way
+// reads them locally. Without libnuma, on single-node hosts or when
+// disabled, there is a single part.
+class NumaSharding {
+ public:
+  static const NumaSharding& Get() {
+    static const NumaSharding sharding;
+    return sharding;
+  }
+
+  int num_nodes() const { return num_nodes_; }
+
+  // first flat index of the part of "node" (or "N" for "num_nodes()")
+  int64 PartBegin(int node, int64 N) const {
+    return (node * N + num_nodes_ - 1) / num_nodes_;
+  }
+
+  // node of the part containing the flat index "i"
+  int Node(int64 i, int64 N) const {
+    return static_cast<int>(i * num_nodes_ / N);
+  }
+
+ private:
+  NumaSharding() : num_nodes_(1) {
+#if MATRIX_ADD_NUMA
+    bool pin = false;
+    TF_CHECK_OK(ReadBoolFromEnvVar("MATRIX_ADD_NUMA_PIN", false, &pin));
+    if (pin && numa_available() >= 0)
+      num_nodes_ = std::max(1, numa_num_configured_nodes());
+    VLOG(1) << "MatrixAdd shards across " << num_nodes_ << " NUMA node(s)";
+#endif
+  }
+
+  int num_nodes_;
+};
+
+// Restricts the calling thread to the CPUs of a node for the lifetime of
+// the object and restores its previous affinity afterwards. The threads
+// are the shared intra-op pool (and the inter-op thread of the op if
+// "parallelFor" runs a shard inline), which every other op uses as well.
+class ScopedNumaPin {
+ public:
+  explicit ScopedNumaPin(const NumaSharding& numa) : numa_(numa) {}
+
+  ~ScopedNumaPin() {
+#if MATRIX_ADD_NUMA
+    if (saved_ != nullptr) {
+      numa_sched_setaffinity(0, saved_);
+      numa_free_cpumask(saved_);
+    }
+#endif
+  }
+
+  void RunOnNode(int node) {
+#if MATRIX_ADD_NUMA
+    if (numa_.num_nodes() == 1 || node == node_)
+      return;
+    if (saved_ == nullptr) {
+      saved_ = numa_allocate_cpumask();
+      if (numa_sched_getaffinity(0, saved_) < 0) {
+        // could not be restored, hence not pinned at all
+        numa_free_cpumask(saved_);
+        saved_ = nullptr;
+        return;
+      }
+    }
+    if (numa_run_on_node(node) == 0)
+      node_ = node;
+#endif
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(ScopedNumaPin);
+
+  const NumaSharding& numa_;
+#if MATRIX_ADD_NUMA
+  int node_ = -1;
+  struct bitmask* saved_ = nullptr;
+#endif
+};
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#endif  // MATRIX_ADD_KERNELS_MATRIX_ADD_NUMA_H_
@@ -2,13 +2,180 @@
 
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/util/bcast.h"
 
 #include <stdio.h>
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
 
+#include "elementwise_binary_op.h"
 #include "matrix_add_op.h"
+#include "matrix_add_trace.h"
 
 namespace tensorflow {
 
+namespace {
+
+using ::tensorflow::functor::Activation;
+using ::tensorflow::functor::BinaryBroadcast;
+using ::tensorflow::functor::BroadcastIndex;
+using ::tensorflow::functor::BroadcastReduction;
+using ::tensorflow::functor::CheckBroadcast;
+using ::tensorflow::functor::Epilogue;
+using ::tensorflow::functor::GetEpilogueAttrs;
+using ::tensorflow::functor::MakeBroadcastIndex;
+using ::tensorflow::functor::PrepareBinaryOp;
+using ::tensorflow::functor::QuantizedAddParams;
+
+// Sum of the output gradient (shape "output_dims") over all axes along
+// which the input (shape "input_dims") has been broadcasted.
+BroadcastReduction MakeBroadcastReduction(const BCast::Vec& input_dims,
+                                          const BCast::Vec& output_dims) {
+  BroadcastReduction reduction;
+  reduction.kept.ndims = 0;
+  reduction.reduced.ndims = 0;
+  reduction.reduce_size = 1;
+
+  int64 stride = 1;
+  for (int k = output_dims.size() - 1; k >= 0; --k) {
+    BroadcastIndex& index = (input_dims[k] == 1 && output_dims[k] != 1) ?
+                            reduction.reduced : reduction.kept;
+    index.dims[index.ndims] = output_dims[k];
+    index.strides[index.ndims] = stride;
+    index.ndims++;
+    stride *= output_dims[k];
+  }
+
+  // the loop above collected the axes from the inner to the outer-most
+  for (BroadcastIndex* index : {&reduction.kept, &reduction.reduced}) {
+    std::reverse(index->dims, index->dims + index->ndims);
+    std::reverse(index->strides, index->strides + index->ndims);
+  }
+  for (int k = 0; k < reduction.reduced.ndims; ++k)
+    reduction.reduce_size *= reduction.reduced.dims[k];
+
+  return reduction;
+}
+
+// view of "tensor" with the given shape (of the same size), which shares
+// its buffer
+Tensor Reshaped(const Tensor& tensor, const TensorShape& shape) {
+  if (tensor.shape() == shape)
+    return tensor;
+  Tensor reshaped;
+  CHECK(reshaped.CopyFrom(tensor, shape));
+  return reshaped;
+}
+
+// Writes the gradients of "matrix_a" and "matrix_b" (inputs and outputs 0
+// and 1) given the gradient "topdiff" w.r.t. "A + B + bias". The buffer of
+// the input "gradients" may be reused for them.
+template<typename Device, typename Dtype>
+void BackpropInputs(OpKernelContext* ctx, const BCast& bcast, const Tensor& topdiff,
+                    int gradients, bool copy_gradients) {
+  const Tensor& mA = ctx->input(0);
+  const Tensor& mB = ctx->input(1);
+
+  // inputs which only differ in leading axes of size 1 from the output
+  // are not broadcasted, their gradient is just a reshaped "topdiff"
+  const bool reduce[2] = {mA.NumElements() != topdiff.NumElements(),
+                          mB.NumElements() != topdiff.NumElements()};
+
+  if (reduce[0] || reduce[1]) {
+    const BCast::Vec* input_dims[2] = {&bcast.x_reshape(), &bcast.y_reshape()};
+
+    for (int i = 0; i < 2; ++i) {
+      if (!reduce[i] && !copy_gradients) {
+        ctx->set_output(i, Reshaped(topdiff, ctx->input(i).shape()));
+        continue;
+      }
+      // sum over the broadcasted axes (if any)
+      Tensor* grad = nullptr;
+      OP_REQUIRES_OK(ctx, ctx->allocate_output(i, ctx->input(i).shape(), &grad));
+      ::tensorflow::functor::MatrixAddGradReduce<Device, Dtype>()(ctx,
+          topdiff, grad,
+          MakeBroadcastReduction(*input_dims[i], bcast.result_shape()));
+    }
+    return;
+  }
+
+  if (!copy_gradients) {
+    // d(A+B+bias)/dA = d(A+B+bias)/dB = identity, hence both outputs just
+    // share the (refcounted) buffer of "topdiff" without any copy
+    ctx->set_output(0, Reshaped(topdiff, mA.shape()));
+    ctx->set_output(1, Reshaped(topdiff, mB.shape()));
+    return;
+  }
+
+  Tensor* grad_mA = nullptr;
+  Tensor* grad_mB = nullptr;
+  // the gradient w.r.t. "matrix_a" is "gradients" itself, so we can
+  // reuse its buffer when it is not consumed anywhere else
+  OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({gradients}, 0,
+                 mA.shape(), &grad_mA));
+  OP_REQUIRES_OK(ctx, ctx->allocate_output(1, mB.shape(), &grad_mB));
+
+  ::tensorflow::functor::MatrixAddGrad<Device, Dtype>()(ctx,
+      topdiff, grad_mA, grad_mB);
+}
+
+// the bias of "MatrixAddV2" is a single value or one per channel
+Status CheckBias(const Tensor& bias, const TensorShape& output_shape) {
+  if (bias.dims() <= 1 && bias.NumElements() == 1)
+    return Status::OK();
+  if (bias.dims() == 1 && output_shape.dims() >= 1 &&
+      bias.dim_size(0) == output_shape.dim_size(output_shape.dims() - 1))
+    return Status::OK();
+  return errors::InvalidArgument("Bias must be a scalar or match the last axis of the output ",
+                                 output_shape.DebugString(), ", got ",
+                                 bias.shape().DebugString());
+}
+
+// fixed-point form of "QuantizedMatrixAdd" (see "QuantizedAddParams") for
+// a type of the values [lowest, highest]
+Status MakeQuantizedAddParams(float min_a, float max_a, float min_b, float max_b,
+                              float min_c, float max_c, float bias, bool relu,
+                              int lowest, int highest, QuantizedAddParams* params) {
+  if (!(min_a < max_a && min_b < max_b && min_c < max_c))
+    return errors::InvalidArgument("Quantization ranges must not be empty, got [",
+                                   min_a, ", ", max_a, "], [", min_b, ", ", max_b,
+                                   "] and [", min_c, ", ", max_c, "]");
+
+  const double levels = highest - lowest;
+  const double scale_c = (static_cast<double>(max_c) - min_c) / levels;
+  const double ratio_a = (static_cast<double>(max_a) - min_a) / levels / scale_c;
+  const double ratio_b = (static_cast<double>(max_b) - min_b) / levels / scale_c;
+  const double offset = (static_cast<double>(min_a) + min_b + bias - min_c) / scale_c + lowest;
+
+  // the most precise shift for which the sum (including the rounding)
+  // cannot overflow 32 bits
+  const double magnitude = levels * (ratio_a + ratio_b) + std::abs(offset) + 1;
+  int shift = 30;
+  while (shift > 0 && std::ldexp(magnitude, shift) >= std::ldexp(1., 30))
+    --shift;
+  if (std::ldexp(magnitude, shift) >= std::ldexp(1., 30))
+    return errors::InvalidArgument("Output range [", min_c, ", ", max_c,
+                                   "] is too narrow for the input ranges");
+
+  params->multiplier_a = static_cast<int32>(std::lround(std::ldexp(ratio_a, shift)));
+  params->multiplier_b = static_cast<int32>(std::lround(std::ldexp(ratio_b, shift)));
+  params->offset = static_cast<int32>(std::llround(std::ldexp(offset, shift))) +
+                   (shift > 0 ? (1 << (shift - 1)) : 0);
+  params->shift = shift;
+  params->highest = highest;
+  params->lowest = lowest;
+  if (relu) {
+    // quantized value of 0
+    const double zero = std::round(-min_c / scale_c) + lowest;
+    params->lowest = static_cast<int32>(std::min<double>(highest, std::max<double>(lowest, zero)));
+  }
+  return Status::OK();
+}
+
+}  // namespace
+
 // Forward-Pass (CPU, GPU)
 // --------------------------------------------------
 template<typename Device, typename Dtype>
@@ -18,33 +185,78 @@ class MatrixAddOp: public OpKernel {
     OpKernel(ctx) {
     OP_REQUIRES_OK(ctx,
                    ctx->GetAttr("bias", &bias_));
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
   }
 
   void Compute(OpKernelContext* ctx) override {
     const Tensor& mA = ctx->input(0);
     const Tensor& mB = ctx->input(1);
 
-    OP_REQUIRES(ctx, mA.shape() == mB.shape(), errors::InvalidArgument("Input shapes have to be the same"));
+    BinaryBroadcast broadcast;
+    Tensor* mC = nullptr;
+    OP_REQUIRES_OK(ctx, PrepareBinaryOp(ctx, &broadcast, &mC));
 
-    const int B = mA.dim_size(0);
-    const int M = mA.dim_size(1);
-    const int N = mA.dim_size(2);
-    const int D = mA.dim_size(3);
+    MATRIX_ADD_TRACE("MatrixAdd", broadcast.flat ? "flat" : "broadcast", *mC,
+                     mA.TotalBytes() + mB.TotalBytes() + mC->TotalBytes());
 
-    TensorShape output_shape({B, M, N, D});
-    // same as: output_shape.AddDim(B); ....
+    if (broadcast.flat) {
+      ::tensorflow::functor::MatrixAddFunctor<Device, Dtype>()(ctx,
+          mA, mB, mC, static_cast<Dtype>(bias_), epilogue_);
+    } else {
+      // the smaller input is never materialized in its broadcasted shape
+      ::tensorflow::functor::MatrixAddBroadcastFunctor<Device, Dtype>()(ctx,
+          mA, mB, mC, static_cast<Dtype>(bias_), epilogue_,
+          broadcast.index_a, broadcast.index_b);
+    }
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddOp);
+  float bias_;
+  Epilogue epilogue_;
+};
+
+// Forward-Pass with "matrix_a" in host memory (GPU)
+// --------------------------------------------------
+// Selected by the kernel label "host_a" (see "matrix_add_host_a" in Python).
+// Instead of a synchronous copy in front of the op, "matrix_a" is copied
+// in chunks overlapping with the computation.
+template<typename Device, typename Dtype>
+class MatrixAddHostOp: public OpKernel {
+ public:
+  explicit MatrixAddHostOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& mA = ctx->input(0);
+    const Tensor& mB = ctx->input(1);
+
+    OP_REQUIRES(ctx, mA.shape() == mB.shape(),
+                errors::Unimplemented("Host memory inputs cannot be broadcasted, got ",
+                                      mA.shape().DebugString(), " and ",
+                                      mB.shape().DebugString()));
 
     Tensor* mC = nullptr;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, output_shape, &mC));
-    // same as "OP_REQUIRES_OK(ctx,ctx->allocate_output(0, mA.tensor<Dtype, 4>().shape(), &mC));"
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({1}, 0,
+                   mB.shape(), &mC));
+
+    MATRIX_ADD_TRACE("MatrixAdd", "host_a", *mC,
+                     2 * mA.TotalBytes() + mB.TotalBytes() + mC->TotalBytes());
 
-    ::tensorflow::functor::MatrixAddFunctor<Device, Dtype>()(ctx,
-        mA, mB, mC, bias_);
+    ::tensorflow::functor::MatrixAddHostFunctor<Device, Dtype>()(ctx,
+        mA, mB, mC, static_cast<Dtype>(bias_), epilogue_);
   }
 
  private:
-  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddOp);
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddHostOp);
   float bias_;
+  Epilogue epilogue_;
 };
 
 // Backward-Pass (CPU, GPU)
@@ -54,21 +266,439 @@ class MatrixAddGradOp: public OpKernel {
  public:
   explicit MatrixAddGradOp(OpKernelConstruction* ctx) :
     OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("copy_gradients", &copy_gradients_));
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
   }
 
   void Compute(OpKernelContext* ctx) override {
     const Tensor& mA = ctx->input(0);
     const Tensor& mB = ctx->input(1);
-    const Tensor& topdiff = ctx->input(2);
+    const Tensor& gradients = ctx->input(2);
+    const Tensor& output = ctx->input(3);
+
+    BCast bcast(BCast::FromShape(mA.shape()), BCast::FromShape(mB.shape()));
+    OP_REQUIRES_OK(ctx, CheckBroadcast(bcast, mA, mB));
+    OP_REQUIRES(ctx, BCast::ToShape(bcast.output_shape()) == gradients.shape() &&
+                     output.shape() == gradients.shape(),
+                errors::InvalidArgument("Gradients must have the shape of the output"));
 
-    Tensor* grad_mA = nullptr;
-    Tensor* grad_mB = nullptr;
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(0, mA.shape(), &grad_mA));
-    OP_REQUIRES_OK(ctx, ctx->allocate_output(1, mB.shape(), &grad_mB));
+    // a scale also needs the activation pass (with the identity)
+    const bool activation = epilogue_.activation != Activation::kNone || epilogue_.scale != 1;
+    const bool broadcasted = mA.NumElements() != gradients.NumElements() ||
+                             mB.NumElements() != gradients.NumElements();
+    // the activation pass reads four and writes one tensor, copies and
+    // reductions read one and write two, aliased outputs are free
+    MATRIX_ADD_TRACE("MatrixAddGrad",
+                     broadcasted ? "reduce" : copy_gradients_ ? "copy" : "alias",
+                     gradients,
+                     gradients.TotalBytes() * ((activation ? 5 : 0) +
+                                               (broadcasted || copy_gradients_ ? 3 : 0)));
 
-    ::tensorflow::functor::MatrixAddGrad<Device, Dtype>()(ctx,
-        topdiff, grad_mA, grad_mB);
+    // backprop through the activation and the scale first, from there on
+    // the gradient is the identity again (up to broadcasting)
+    const Tensor* topdiff = &gradients;
+    Tensor activation_grad;
+    if (activation) {
+      OP_REQUIRES_OK(ctx, ctx->allocate_temp(DataTypeToEnum<Dtype>::value,
+                     gradients.shape(), &activation_grad));
+      ::tensorflow::functor::MatrixAddActivationGrad<Device, Dtype>()(ctx,
+          gradients, output, mA, mB, static_cast<Dtype>(bias_), epilogue_,
+          MakeBroadcastIndex(bcast.x_reshape(), bcast.result_shape()),
+          MakeBroadcastIndex(bcast.y_reshape(), bcast.result_shape()),
+          &activation_grad);
+      topdiff = &activation_grad;
+    }
+
+    BackpropInputs<Device, Dtype>(ctx, bcast, *topdiff, 2, copy_gradients_);
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddGradOp);
+  float bias_;
+  bool copy_gradients_;
+  Epilogue epilogue_;
+};
+
+// Forward-Pass with the bias as input (CPU, GPU)
+// --------------------------------------------------
+// In contrast to the "bias" attr of "MatrixAdd" a new value does not
+// instantiate a new kernel, and the bias can be trained.
+template<typename Device, typename Dtype>
+class MatrixAddV2Op: public OpKernel {
+ public:
+  explicit MatrixAddV2Op(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& mA = ctx->input(0);
+    const Tensor& mB = ctx->input(1);
+    const Tensor& bias = ctx->input(2);
+
+    BCast bcast(BCast::FromShape(mA.shape()), BCast::FromShape(mB.shape()));
+    OP_REQUIRES_OK(ctx, CheckBroadcast(bcast, mA, mB));
+
+    const TensorShape output_shape = BCast::ToShape(bcast.output_shape());
+    OP_REQUIRES_OK(ctx, CheckBias(bias, output_shape));
+
+    Tensor* mC = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({0, 1}, 0,
+                   output_shape, &mC));
+
+    MATRIX_ADD_TRACE("MatrixAddV2", "bias", *mC,
+                     mA.TotalBytes() + mB.TotalBytes() + bias.TotalBytes() + mC->TotalBytes());
+
+    ::tensorflow::functor::MatrixAddBiasFunctor<Device, Dtype>()(ctx,
+        mA, mB, bias, mC, epilogue_,
+        MakeBroadcastIndex(bcast.x_reshape(), bcast.result_shape()),
+        MakeBroadcastIndex(bcast.y_reshape(), bcast.result_shape()));
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddV2Op);
+  Epilogue epilogue_;
+};
+
+// Backward-Pass with the bias as input (CPU, GPU)
+// --------------------------------------------------
+template<typename Device, typename Dtype>
+class MatrixAddV2GradOp: public OpKernel {
+ public:
+  explicit MatrixAddV2GradOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("copy_gradients", &copy_gradients_));
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
   }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& mA = ctx->input(0);
+    const Tensor& mB = ctx->input(1);
+    const Tensor& bias = ctx->input(2);
+    const Tensor& gradients = ctx->input(3);
+    const Tensor& output = ctx->input(4);
+
+    BCast bcast(BCast::FromShape(mA.shape()), BCast::FromShape(mB.shape()));
+    OP_REQUIRES_OK(ctx, CheckBroadcast(bcast, mA, mB));
+    OP_REQUIRES(ctx, BCast::ToShape(bcast.output_shape()) == gradients.shape() &&
+                     output.shape() == gradients.shape(),
+                errors::InvalidArgument("Gradients must have the shape of the output"));
+    OP_REQUIRES_OK(ctx, CheckBias(bias, gradients.shape()));
+
+    const bool scaled = epilogue_.scale != 1;
+    const bool activation = epilogue_.activation != Activation::kNone || scaled;
+    MATRIX_ADD_TRACE("MatrixAddV2Grad", activation ? "activation" : "identity", gradients,
+                     gradients.TotalBytes() * ((activation ? 5 : 0) + (scaled ? 1 : 0) + 3));
+
+    // the bias is added after the scale, so its gradient "topdiff" differs
+    // from the one of the inputs "topdiff_sum" for a scale != 1
+    const Tensor* topdiff = &gradients;
+    const Tensor* topdiff_sum = &gradients;
+    Tensor activation_grad, activation_grad_sum;
+    if (activation) {
+      OP_REQUIRES_OK(ctx, ctx->allocate_temp(DataTypeToEnum<Dtype>::value,
+                     gradients.shape(), &activation_grad));
+      if (scaled) {
+        OP_REQUIRES_OK(ctx, ctx->allocate_temp(DataTypeToEnum<Dtype>::value,
+                       gradients.shape(), &activation_grad_sum));
+      }
+      ::tensorflow::functor::MatrixAddBiasActivationGrad<Device, Dtype>()(ctx,
+          gradients, output, mA, mB, bias, epilogue_,
+          MakeBroadcastIndex(bcast.x_reshape(), bcast.result_shape()),
+          MakeBroadcastIndex(bcast.y_reshape(), bcast.result_shape()),
+          &activation_grad, scaled ? &activation_grad_sum : nullptr);
+      topdiff = &activation_grad;
+      topdiff_sum = scaled ? &activation_grad_sum : &activation_grad;
+    }
+
+    // the bias is broadcasted over all but (maybe) the last axis
+    BCast bias_bcast(BCast::FromShape(bias.shape()), BCast::FromShape(gradients.shape()));
+    Tensor* grad_bias = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, bias.shape(), &grad_bias));
+    ::tensorflow::functor::MatrixAddGradReduce<Device, Dtype>()(ctx,
+        *topdiff, grad_bias,
+        MakeBroadcastReduction(bias_bcast.x_reshape(), bias_bcast.result_shape()));
+
+    BackpropInputs<Device, Dtype>(ctx, bcast, *topdiff_sum, 3, copy_gradients_);
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddV2GradOp);
+  bool copy_gradients_;
+  Epilogue epilogue_;
+};
+
+// Forward-Pass of the N-ary version (CPU, GPU)
+// --------------------------------------------------
+template<typename Device, typename Dtype>
+class MatrixAddNOp: public OpKernel {
+ public:
+  explicit MatrixAddNOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    OpInputList inputs;
+    OP_REQUIRES_OK(ctx, ctx->input_list("inputs", &inputs));
+
+    const TensorShape& output_shape = inputs[0].shape();
+    for (int i = 1; i < inputs.size(); ++i) {
+      OP_REQUIRES(ctx, inputs[i].shape() == output_shape,
+                  errors::InvalidArgument("Input shapes have to be the same, got ",
+                                          output_shape.DebugString(), " and ",
+                                          inputs[i].shape().DebugString()));
+    }
+
+    std::vector<int> candidates(inputs.size());
+    std::iota(candidates.begin(), candidates.end(), 0);
+
+    Tensor* mC = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output(candidates, 0,
+                   output_shape, &mC));
+
+    // a forwarded input has to be summed up first, before its buffer
+    // gets overwritten by the result
+    std::vector<const Tensor*> summands;
+    for (int i = 0; i < inputs.size(); ++i) {
+      if (inputs[i].SharesBufferWith(*mC))
+        summands.insert(summands.begin(), &inputs[i]);
+      else
+        summands.push_back(&inputs[i]);
+    }
+
+    MATRIX_ADD_TRACE("MatrixAddN", "n", *mC, (inputs.size() + 1) * mC->TotalBytes());
+
+    ::tensorflow::functor::MatrixAddNFunctor<Device, Dtype>()(ctx,
+        summands, mC, static_cast<Dtype>(bias_));
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddNOp);
+  float bias_;
+};
+
+// Forward-Pass of many independent pairs (CPU, GPU)
+// --------------------------------------------------
+template<typename Device, typename Dtype>
+class MatrixAddGroupedOp: public OpKernel {
+ public:
+  explicit MatrixAddGroupedOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    OpInputList matrix_a, matrix_b;
+    OP_REQUIRES_OK(ctx, ctx->input_list("matrix_a", &matrix_a));
+    OP_REQUIRES_OK(ctx, ctx->input_list("matrix_b", &matrix_b));
+
+    const int num_groups = matrix_a.size();
+    std::vector<const Tensor*> mA(num_groups), mB(num_groups);
+    std::vector<Tensor*> mC(num_groups, nullptr);
+
+    for (int k = 0; k < num_groups; ++k) {
+      OP_REQUIRES(ctx, matrix_a[k].shape() == matrix_b[k].shape(),
+                  errors::InvalidArgument("Input shapes of group ", k, " have to be the same, got ",
+                                          matrix_a[k].shape().DebugString(), " and ",
+                                          matrix_b[k].shape().DebugString()));
+      mA[k] = &matrix_a[k];
+      mB[k] = &matrix_b[k];
+
+      // the inputs of group "k" are the inputs "k" and "num_groups + k"
+      OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({k, num_groups + k}, k,
+                     matrix_a[k].shape(), &mC[k]));
+    }
+
+    MATRIX_ADD_TRACE("MatrixAddGrouped", "grouped", *mC[0],
+                     std::accumulate(mC.begin(), mC.end(), int64(0),
+                     [](int64 bytes, const Tensor* t) { return bytes + 3 * t->TotalBytes(); }));
+
+    ::tensorflow::functor::MatrixAddGroupedFunctor<Device, Dtype>()(ctx,
+        mA, mB, mC, static_cast<Dtype>(bias_));
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddGroupedOp);
+  float bias_;
+};
+
+// Backward-Pass of the N-ary version (CPU, GPU)
+// --------------------------------------------------
+template<typename Device, typename Dtype>
+class MatrixAddNGradOp: public OpKernel {
+ public:
+  explicit MatrixAddNGradOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("N", &num_inputs_));
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("copy_gradients", &copy_gradients_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& topdiff = ctx->input(0);
+
+    MATRIX_ADD_TRACE("MatrixAddNGrad", copy_gradients_ ? "copy" : "alias", topdiff,
+                     copy_gradients_ ? (num_inputs_ + 1) * topdiff.TotalBytes() : 0);
+
+    if (!copy_gradients_) {
+      // same as for "MatrixAddGrad", all gradients are just "topdiff"
+      for (int i = 0; i < num_inputs_; ++i)
+        ctx->set_output(i, topdiff);
+      return;
+    }
+
+    std::vector<Tensor*> grads(num_inputs_, nullptr);
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({0}, 0,
+                   topdiff.shape(), &grads[0]));
+    for (int i = 1; i < num_inputs_; ++i)
+      OP_REQUIRES_OK(ctx, ctx->allocate_output(i, topdiff.shape(), &grads[i]));
+
+    ::tensorflow::functor::MatrixAddNGrad<Device, Dtype>()(ctx,
+        topdiff, grads);
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddNGradOp);
+  int num_inputs_;
+  bool copy_gradients_;
+};
+
+
+// Backward-Pass for sparse gradients (CPU, GPU)
+// --------------------------------------------------
+// Backprops the rows "gradients" (of an IndexedSlices) of the output through
+// the activation, only the rows referenced by "indices" are touched. Without
+// an activation the sparse gradient is passed through in Python directly.
+template<typename Device, typename Dtype, typename Index>
+class MatrixAddSparseGradOp: public OpKernel {
+ public:
+  explicit MatrixAddSparseGradOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+    OP_REQUIRES_OK(ctx,
+                   GetEpilogueAttrs(ctx, &epilogue_));
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& values = ctx->input(0);
+    const Tensor& indices = ctx->input(1);
+    const Tensor& mA = ctx->input(2);
+    const Tensor& mB = ctx->input(3);
+    const Tensor& output = ctx->input(4);
+
+    OP_REQUIRES(ctx, mA.shape() == output.shape() && mB.shape() == output.shape(),
+                errors::InvalidArgument("Sparse gradients require inputs of the output-shape, got ",
+                                        mA.shape().DebugString(), " and ",
+                                        mB.shape().DebugString()));
+    OP_REQUIRES(ctx, output.dims() >= 1,
+                errors::InvalidArgument("Output must be at least 1-D"));
+    OP_REQUIRES(ctx, TensorShapeUtils::IsVector(indices.shape()),
+                errors::InvalidArgument("Indices must be a vector"));
+
+    TensorShape values_shape = output.shape();
+    values_shape.set_dim(0, indices.dim_size(0));
+    OP_REQUIRES(ctx, values.shape() == values_shape,
+                errors::InvalidArgument("Gradients must have the shape ",
+                                        values_shape.DebugString(), ", got ",
+                                        values.shape().DebugString()));
+
+    // reads the rows of four tensors and writes one
+    MATRIX_ADD_TRACE("MatrixAddSparseGrad", "sparse", values, values.TotalBytes() * 5);
+
+    Tensor* grad = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->forward_input_or_allocate_output({0}, 0,
+                   values.shape(), &grad));
+
+    const int64 bad = ::tensorflow::functor::MatrixAddSparseActivationGrad<Device, Dtype, Index>()(ctx,
+        values, indices, output, mA, mB, static_cast<Dtype>(bias_), epilogue_, grad);
+    OP_REQUIRES(ctx, bad < 0,
+                errors::InvalidArgument("indices[", bad, "] is not in [0, ",
+                                        output.dim_size(0), ")"));
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddSparseGradOp);
+  float bias_;
+  Epilogue epilogue_;
+};
+
+
+// Forward-Pass of quantized inputs (CPU, GPU)
+// --------------------------------------------------
+// The ranges are scalars in host memory, the output range is given (e.g.
+// calibrated) instead of computed, so the result is requantized in the same
+// pass without a reduction over the output.
+template<typename Device, typename T>
+class QuantizedMatrixAddOp: public OpKernel {
+ public:
+  explicit QuantizedMatrixAddOp(OpKernelConstruction* ctx) :
+    OpKernel(ctx) {
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("bias", &bias_));
+    string activation;
+    OP_REQUIRES_OK(ctx,
+                   ctx->GetAttr("activation", &activation));
+    relu_ = activation == "relu";
+  }
+
+  void Compute(OpKernelContext* ctx) override {
+    const Tensor& mA = ctx->input(0);
+    const Tensor& mB = ctx->input(1);
+
+    float range[6];
+    for (int i = 0; i < 6; ++i) {
+      const Tensor& value = ctx->input(2 + i);
+      OP_REQUIRES(ctx, TensorShapeUtils::IsScalar(value.shape()),
+                  errors::InvalidArgument("Ranges must be scalars, got ",
+                                          value.shape().DebugString()));
+      range[i] = value.scalar<float>()();
+    }
+
+    QuantizedAddParams params;
+    OP_REQUIRES_OK(ctx, MakeQuantizedAddParams(range[0], range[1], range[2], range[3],
+                   range[4], range[5], bias_, relu_,
+                   static_cast<int>(Eigen::NumTraits<T>::lowest()),
+                   static_cast<int>(Eigen::NumTraits<T>::highest()), &params));
+
+    BinaryBroadcast broadcast;
+    Tensor* mC = nullptr;
+    OP_REQUIRES_OK(ctx, PrepareBinaryOp(ctx, &broadcast, &mC));
+
+    MATRIX_ADD_TRACE("QuantizedMatrixAdd", broadcast.flat ? "flat" : "broadcast", *mC,
+                     mA.TotalBytes() + mB.TotalBytes() + mC->TotalBytes());
+
+    if (broadcast.flat) {
+      ::tensorflow::functor::QuantizedMatrixAddFunctor<Device, T>()(ctx,
+          mA, mB, mC, params);
+    } else {
+      ::tensorflow::functor::QuantizedMatrixAddBroadcastFunctor<Device, T>()(ctx,
+          mA, mB, mC, params, broadcast.index_a, broadcast.index_b);
+    }
+
+    Tensor* output_min = nullptr;
+    Tensor* output_max = nullptr;
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(1, TensorShape({}), &output_min));
+    OP_REQUIRES_OK(ctx, ctx->allocate_output(2, TensorShape({}), &output_max));
+    output_min->scalar<float>()() = range[4];
+    output_max->scalar<float>()() = range[5];
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(QuantizedMatrixAddOp);
+  float bias_;
+  bool relu_;
 };
 
 
@@ -85,8 +715,91 @@ class MatrixAddGradOp: public OpKernel {
 REGISTER(MatrixAdd, int);
 REGISTER(MatrixAdd, float);
 REGISTER(MatrixAdd, double);
+REGISTER(MatrixAdd, Eigen::half);
+REGISTER(MatrixAdd, bfloat16);
 REGISTER(MatrixAddGrad, float);
 REGISTER(MatrixAddGrad, double);
+REGISTER(MatrixAddGrad, Eigen::half);
+REGISTER(MatrixAddGrad, bfloat16);
+REGISTER(MatrixAddV2, int);
+REGISTER(MatrixAddV2, float);
+REGISTER(MatrixAddV2, double);
+REGISTER(MatrixAddV2, Eigen::half);
+REGISTER(MatrixAddV2, bfloat16);
+REGISTER(MatrixAddV2Grad, float);
+REGISTER(MatrixAddV2Grad, double);
+REGISTER(MatrixAddV2Grad, Eigen::half);
+REGISTER(MatrixAddV2Grad, bfloat16);
+REGISTER(MatrixAddN, int);
+REGISTER(MatrixAddN, float);
+REGISTER(MatrixAddN, double);
+REGISTER(MatrixAddN, Eigen::half);
+REGISTER(MatrixAddN, bfloat16);
+REGISTER(MatrixAddGrouped, int);
+REGISTER(MatrixAddGrouped, float);
+REGISTER(MatrixAddGrouped, double);
+REGISTER(MatrixAddGrouped, Eigen::half);
+REGISTER(MatrixAddGrouped, bfloat16);
+REGISTER(MatrixAddNGrad, float);
+REGISTER(MatrixAddNGrad, double);
+REGISTER(MatrixAddNGrad, Eigen::half);
+REGISTER(MatrixAddNGrad, bfloat16);
+
+#define REGISTER_HOST(Dtype)                                           \
+  REGISTER_KERNEL_BUILDER(                                             \
+      Name("MatrixAdd")                                                \
+          .Device(DEVICE_GPU)                                          \
+          .TypeConstraint<Dtype>("T")                                  \
+          .HostMemory("matrix_a")                                      \
+          .Label("host_a"),                                            \
+      MatrixAddHostOp<GPUDevice, Dtype>);
+
+REGISTER_HOST(int);
+REGISTER_HOST(float);
+REGISTER_HOST(double);
+REGISTER_HOST(Eigen::half);
+REGISTER_HOST(bfloat16);
+
+#define REGISTER_SPARSE(Device, DEVICE, Dtype, Index)                   \
+  REGISTER_KERNEL_BUILDER(                                             \
+      Name("MatrixAddSparseGrad")                                      \
+          .Device(DEVICE)                                              \
+          .TypeConstraint<Dtype>("T")                                  \
+          .TypeConstraint<Index>("Tindices"),                          \
+      MatrixAddSparseGradOp<Device, Dtype, Index>);
+#define REGISTER_SPARSE_ALL(Dtype)                                     \
+  REGISTER_SPARSE(CPUDevice, DEVICE_CPU, Dtype, int32);                \
+  REGISTER_SPARSE(CPUDevice, DEVICE_CPU, Dtype, int64);                \
+  REGISTER_SPARSE(GPUDevice, DEVICE_GPU, Dtype, int32);                \
+  REGISTER_SPARSE(GPUDevice, DEVICE_GPU, Dtype, int64);
+
+REGISTER_SPARSE_ALL(float);
+REGISTER_SPARSE_ALL(double);
+REGISTER_SPARSE_ALL(Eigen::half);
+REGISTER_SPARSE_ALL(bfloat16);
+
+#define REGISTER_QUANTIZED(T)                                          \
+  REGISTER_KERNEL_BUILDER(                                             \
+      Name("QuantizedMatrixAdd")                                       \
+          .Device(DEVICE_CPU)                                          \
+          .TypeConstraint<T>("T"),                                     \
+      QuantizedMatrixAddOp<CPUDevice, T>);                             \
+  REGISTER_KERNEL_BUILDER(                                             \
+      Name("QuantizedMatrixAdd")                                       \
+          .Device(DEVICE_GPU)                                          \
+          .TypeConstraint<T>("T")                                      \
+          .HostMemory("min_a")                                         \
+          .HostMemory("max_a")                                         \
+          .HostMemory("min_b")                                         \
+          .HostMemory("max_b")                                         \
+          .HostMemory("min_output")                                    \
+          .HostMemory("max_output")                                    \
+          .HostMemory("output_min")                                    \
+          .HostMemory("output_max"),                                   \
+      QuantizedMatrixAddOp<GPUDevice, T>);
+
+REGISTER_QUANTIZED(qint8);
+REGISTER_QUANTIZED(quint8);
 
 
 
@@ -3,6 +3,10 @@
 #ifndef MATRIX_ADD_KERNELS_MATRIX_ADD_OP_H_
 #define MATRIX_ADD_KERNELS_MATRIX_ADD_OP_H_
 
+#include <cmath>
+#include <utility>
+#include <vector>
+
 #include "tensorflow/core/framework/op_kernel.h"
 
 namespace tensorflow {
@@ -17,13 +21,230 @@ using GPUDevice = Eigen::GpuDevice;
 namespace tensorflow {
 namespace functor {
 
+// Maps a flat index over "dims" (row-major) to an offset into another
+// buffer by using per-axis "strides". A stride of 0 repeats the same
+// values along this axis, which is how broadcasting is expressed.
+struct BroadcastIndex {
+  enum { kMaxDims = 8 };
+
+  int ndims;
+  int64 dims[kMaxDims];
+  int64 strides[kMaxDims];
+
+  EIGEN_DEVICE_FUNC int64 operator()(int64 i) const {
+    int64 offset = 0;
+    for (int k = ndims - 1; k >= 0; --k) {
+      offset += (i % dims[k]) * strides[k];
+      i /= dims[k];
+    }
+    return offset;
+  }
+};
+
+// Type used for intermediate results. Half precision and bfloat16 values
+// are summed in float, so the result is rounded only once.
+template <typename T>
+struct AccumulatorType { typedef T type; };
+
+template <>
+struct AccumulatorType<Eigen::half> { typedef float type; };
+
+template <>
+struct AccumulatorType<bfloat16> { typedef float type; };
+
+// floating point type for transcendental functions (also for integers)
+template <typename T>
+struct FloatType { typedef float type; };
+
+template <>
+struct FloatType<double> { typedef double type; };
+
+// Elementwise activation fused into the kernels, applied to
+// "scale * (A + B) + bias".
+enum class Activation { kNone, kRelu, kLeakyRelu, kGelu };
+
+struct Epilogue {
+  Activation activation;
+  float alpha;  // slope of "leaky_relu" for negative values
+  float scale;  // factor of the sum before the bias is added
+};
+
+// "scale * x" in the type of "x". Integers are scaled in double and
+// truncated, as by a cast of the product.
+template <typename T>
+EIGEN_DEVICE_FUNC inline T ApplyScale(T x, float scale) {
+  return static_cast<T>(scale * x);
+}
+
+template <>
+EIGEN_DEVICE_FUNC inline int ApplyScale<int>(int x, float scale) {
+  return static_cast<int>(static_cast<double>(scale) * x);
+}
+
+// "apply" computes the activation of "x" and "grad" the gradient w.r.t. "x"
+// from the incoming gradient "g" and the saved output "y". Only activations
+// with "kNeedsInput" need the value "x" itself during the backward pass.
+template <Activation A>
+struct ActivationFn;
+
+template <>
+struct ActivationFn<Activation::kNone> {
+  static constexpr bool kNeedsInput = false;
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T x, float alpha) { return x; }
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T grad(T g, T x, T y, float alpha) { return g; }
+};
+
+template <>
+struct ActivationFn<Activation::kRelu> {
+  static constexpr bool kNeedsInput = false;
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T x, float alpha) {
+    return x > T(0) ? x : T(0);
+  }
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T grad(T g, T x, T y, float alpha) {
+    return y > T(0) ? g : T(0);
+  }
+};
+
+template <>
+struct ActivationFn<Activation::kLeakyRelu> {
+  static constexpr bool kNeedsInput = false;
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T x, float alpha) {
+    return x > T(0) ? x : static_cast<T>(alpha * x);
+  }
+
+  // requires "alpha >= 0", such that the sign of "y" equals the sign of "x"
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T grad(T g, T x, T y, float alpha) {
+    return y > T(0) ? g : static_cast<T>(alpha * g);
+  }
+};
+
+// tanh approximation of x * Phi(x)
+template <>
+struct ActivationFn<Activation::kGelu> {
+  static constexpr bool kNeedsInput = true;
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T apply(T x_, float alpha) {
+    typedef typename FloatType<T>::type C;
+    const C x = static_cast<C>(x_);
+    return static_cast<T>(C(0.5) * x * (C(1) + Tanh(Inner(x))));
+  }
+
+  template <typename T>
+  EIGEN_DEVICE_FUNC static T grad(T g, T x_, T y, float alpha) {
+    typedef typename FloatType<T>::type C;
+    const C x = static_cast<C>(x_);
+    const C t = Tanh(Inner(x));
+    const C dinner = C(kSqrt2OverPi) * (C(1) + C(3 * kCoeff) * x * x);
+    const C dgelu = C(0.5) * (C(1) + t) + C(0.5) * x * (C(1) - t * t) * dinner;
+    return static_cast<T>(static_cast<C>(g) * dgelu);
+  }
+
+ private:
+  static constexpr double kSqrt2OverPi = 0.7978845608028654;
+  static constexpr double kCoeff = 0.044715;
+
+  template <typename C>
+  EIGEN_DEVICE_FUNC static C Inner(C x) {
+    return C(kSqrt2OverPi) * (x + C(kCoeff) * x * x * x);
+  }
+
+  template <typename C>
+  EIGEN_DEVICE_FUNC static C Tanh(C x) {
+#if defined(__CUDA_ARCH__)
+    return ::tanh(x);
+#else
+    return std::tanh(x);
+#endif
+  }
+};
+
+// calls "F<A>::Run(args...)" for the activation "A" chosen at runtime
+template <template <Activation> class F, typename... Args>
+void DispatchActivation(Activation activation, Args&&... args) {
+  switch (activation) {
+    case Activation::kNone:
+      F<Activation::kNone>::Run(std::forward<Args>(args)...);
+      break;
+    case Activation::kRelu:
+      F<Activation::kRelu>::Run(std::forward<Args>(args)...);
+      break;
+    case Activation::kLeakyRelu:
+      F<Activation::kLeakyRelu>::Run(std::forward<Args>(args)...);
+      break;
+    case Activation::kGelu:
+      F<Activation::kGelu>::Run(std::forward<Args>(args)...);
+      break;
+  }
+}
+
+// Reduction of a tensor over broadcasted axes. The output element "g" is
+// the sum over all "r < reduce_size" of "input[kept(g) + reduced(r)]".
+struct BroadcastReduction {
+  BroadcastIndex kept;
+  BroadcastIndex reduced;
+  int64 reduce_size;
+};
+
 template <typename Device, typename Dtype>
 struct MatrixAddFunctor {
   void operator ()(::tensorflow::OpKernelContext* ctx,
                    const Tensor& mA_,
                    const Tensor& mB_,
                    Tensor *mC_,
-                   Dtype bias);
+                   Dtype bias,
+                   const Epilogue& epilogue);
+};
+
+// same as "MatrixAddFunctor" with "mA_" in host memory (GPU only), which is
+// copied to the device in chunks overlapping with the computation
+template <typename Device, typename Dtype>
+struct MatrixAddHostFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue);
+};
+
+// same as "MatrixAddFunctor" for inputs of different shapes
+template <typename Device, typename Dtype>
+struct MatrixAddBroadcastFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b);
+};
+
+// same as "MatrixAddBroadcastFunctor" with the bias given as a tensor of
+// either a single value or one value per channel (the inner-most axis of
+// the output), which is read on the device
+template <typename Device, typename Dtype>
+struct MatrixAddBiasFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   Tensor *mC_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b);
 };
 
 template <typename Device, typename Dtype>
@@ -34,6 +255,157 @@ struct MatrixAddGrad {
                    Tensor *grad_mB_);
 };
 
+// sum of an arbitrary number of inputs of the same shape and "bias"
+template <typename Device, typename Dtype>
+struct MatrixAddNFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& inputs,
+                   Tensor *mC_,
+                   Dtype bias);
+};
+
+// "mA_[k] + mB_[k] + bias" for many independent (usually tiny) pairs of
+// inputs, all pairs are processed in a single pass (a single kernel launch)
+template <typename Device, typename Dtype>
+struct MatrixAddGroupedFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const std::vector<const Tensor*>& mA_,
+                   const std::vector<const Tensor*>& mB_,
+                   const std::vector<Tensor*>& mC_,
+                   Dtype bias);
+};
+
+template <typename Device, typename Dtype>
+struct MatrixAddNGrad {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const std::vector<Tensor*>& grads_);
+};
+
+// gradient w.r.t. "A + B" through the activation and the scale of the
+// epilogue
+template <typename Device, typename Dtype>
+struct MatrixAddActivationGrad {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Dtype bias,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_);
+};
+
+// same as "MatrixAddActivationGrad" with the bias of "MatrixAddBiasFunctor",
+// "grad_" is the gradient w.r.t. the bias (not scaled) and "grad_sum_"
+// the one w.r.t. "A + B", which is only needed (not null) for a scale != 1
+template <typename Device, typename Dtype>
+struct MatrixAddBiasActivationGrad {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   const Tensor& output_,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   const Tensor& bias_,
+                   const Epilogue& epilogue,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b,
+                   Tensor *grad_,
+                   Tensor *grad_sum_);
+};
+
+// same as "MatrixAddActivationGrad" for a sparse "topdiff" (IndexedSlices),
+// row "k" of "values_" is the gradient of row "indices_(k)" of the output
+//
+// Returns the position of the first index out of range or -1. On the GPU
+// all indices are assumed to be valid, otherwise the gradients of those
+// rows are zero (like "tf.gather").
+template <typename Device, typename Dtype, typename Index>
+struct MatrixAddSparseActivationGrad {
+  int64 operator ()(::tensorflow::OpKernelContext* ctx,
+                    const Tensor& values_,
+                    const Tensor& indices_,
+                    const Tensor& output_,
+                    const Tensor& mA_,
+                    const Tensor& mB_,
+                    Dtype bias,
+                    const Epilogue& epilogue,
+                    Tensor *grad_);
+};
+
+// gradient of a broadcasted input (sum over all broadcasted axes)
+template <typename Device, typename Dtype>
+struct MatrixAddGradReduce {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& topdiff_,
+                   Tensor *grad_,
+                   const BroadcastReduction& reduction);
+};
+
+// storage of the quantized types
+template <typename T>
+struct QuantizedStorage;
+
+template <>
+struct QuantizedStorage<qint8> { typedef int8 type; };
+
+template <>
+struct QuantizedStorage<quint8> { typedef uint8 type; };
+
+// "QuantizedMatrixAdd" in fixed point. The real value of a quantized "q" of
+// the range [min, max] is "min + (q - lowest) * scale" (like "Dequantize"
+// in MIN_COMBINED mode), hence for the output
+//
+//   q_c = lowest + (a + b + bias - min_c) / scale_c
+//       = (offset + (q_a - lowest) * multiplier_a
+//                 + (q_b - lowest) * multiplier_b) >> shift
+//
+// where the multipliers are the ratios "scale_a / scale_c", "scale_b /
+// scale_c" and "offset" the constant terms (plus the rounding), all scaled
+// by 2^shift. The result is clamped to [lowest, highest] of the output,
+// which also implements "relu" by raising "lowest" to the zero point.
+struct QuantizedAddParams {
+  int32 multiplier_a;
+  int32 multiplier_b;
+  int32 offset;
+  int shift;
+  int32 lowest;
+  int32 highest;
+
+  template <typename S>
+  EIGEN_DEVICE_FUNC S operator()(S a, S b) const {
+    // the signed type is shifted to [0, 255] first
+    const int32 zero = static_cast<S>(-1) < 0 ? 128 : 0;
+    int32 q = (offset + (static_cast<int32>(a) + zero) * multiplier_a +
+                        (static_cast<int32>(b) + zero) * multiplier_b) >> shift;
+    q = q < lowest ? lowest : q;
+    return static_cast<S>(q > highest ? highest : q);
+  }
+};
+
+// "mA_" and "mB_" have the same number of elements
+template <typename Device, typename T>
+struct QuantizedMatrixAddFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params);
+};
+
+template <typename Device, typename T>
+struct QuantizedMatrixAddBroadcastFunctor {
+  void operator ()(::tensorflow::OpKernelContext* ctx,
+                   const Tensor& mA_,
+                   const Tensor& mB_,
+                   Tensor *mC_,
+                   const QuantizedAddParams& params,
+                   const BroadcastIndex& index_a,
+                   const BroadcastIndex& index_b);
+};
+
 
 }  // namespace functor
 }  // namespace tensorflow
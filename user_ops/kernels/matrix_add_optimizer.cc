@@ -0,0 +1,247 @@
+// ComputerGraphics Tuebingen, 2018
+
+// Grappler pass "MatrixAddFusion", which rewrites chains of ops into the
+// fused variants:
+//
+//   MatrixAdd(MatrixAdd(A, B), C)   -> MatrixAddN(A, B, C)
+//   MatrixAdd(MatrixAddN(A, B), C)  -> MatrixAddN(A, B, C)
+//   Relu(MatrixAdd(A, B))           -> MatrixAdd(A, B, activation='relu')
+//   Relu(MatrixAddN(A, B, C))       -> MatrixAdd(MatrixAddN(A, B), C, activation='relu')
+//
+// The "bias" attrs of a chain are summed up. Only inner nodes which have no
+// other consumer (e.g. no gradient), no control edges, no scale and are not
+// fetched are folded, sums are only chained if no input is broadcasted.
+//
+// Custom optimizers are only run when requested by the session config, see
+// "matrix_add_optimizer_config" in "__init__.py".
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/grappler/costs/graph_properties.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+#include "tensorflow/core/grappler/utils.h"
+#include "tensorflow/core/grappler/utils/topological_sort.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+
+bool IsMatrixAdd(const NodeDef& node) { return node.op() == "MatrixAdd"; }
+bool IsMatrixAddN(const NodeDef& node) { return node.op() == "MatrixAddN"; }
+
+bool HasControlInputs(const NodeDef& node) {
+  for (const string& input : node.input())
+    if (IsControlInput(input))
+      return true;
+  return false;
+}
+
+// all inputs of "node" have the same, fully defined shape
+bool HasFlatInputs(const GraphProperties& properties, const NodeDef& node) {
+  if (!properties.HasInputProperties(node.name()))
+    return false;
+  const auto& inputs = properties.GetInputProperties(node.name());
+  if (inputs.empty())
+    return false;
+  const PartialTensorShape shape(inputs[0].shape());
+  if (!shape.IsFullyDefined())
+    return false;
+  for (const auto& input : inputs)
+    if (!shape.IsIdenticalTo(PartialTensorShape(input.shape())))
+      return false;
+  return true;
+}
+
+}  // namespace
+
+class MatrixAddFusion : public CustomGraphOptimizer {
+ public:
+  MatrixAddFusion() {}
+  ~MatrixAddFusion() override {}
+
+  string name() const override { return "MatrixAddFusion"; }
+
+  Status Init(const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override {
+    return Status::OK();
+  }
+
+  Status Optimize(Cluster* cluster, const GrapplerItem& item,
+                  GraphDef* optimized_graph) override {
+    *optimized_graph = item.graph;
+    if (!ContainsMatrixAdd(*optimized_graph))
+      return Status::OK();
+
+    GraphProperties properties(item);
+    TF_RETURN_IF_ERROR(properties.InferStatically(false));
+    TF_RETURN_IF_ERROR(TopologicalSort(optimized_graph));
+
+    preserve_ = item.NodesToPreserve();
+    nodes_.clear();
+    fanout_.clear();
+    removed_.clear();
+    for (NodeDef& node : *optimized_graph->mutable_node()) {
+      nodes_[node.name()] = &node;
+      for (const string& input : node.input())
+        ++fanout_[NodeName(input)];
+    }
+    flat_.clear();
+    for (const NodeDef& node : optimized_graph->node())
+      if ((IsMatrixAdd(node) || IsMatrixAddN(node)) && HasFlatInputs(properties, node))
+        flat_.insert(node.name());
+
+    // producers are visited first, hence chains collapse from the front and
+    // a rewritten node can be folded into its consumer again
+    int rewrites = 0;
+    for (NodeDef& node : *optimized_graph->mutable_node()) {
+      if (IsMatrixAdd(node))
+        rewrites += FuseSum(&node);
+      else if (node.op() == "Relu")
+        rewrites += FuseRelu(&node);
+    }
+
+    if (!removed_.empty()) {
+      GraphDef pruned;
+      *pruned.mutable_library() = optimized_graph->library();
+      *pruned.mutable_versions() = optimized_graph->versions();
+      for (const NodeDef& node : optimized_graph->node())
+        if (removed_.count(node.name()) == 0)
+          *pruned.add_node() = node;
+      optimized_graph->Swap(&pruned);
+    }
+    VLOG(1) << "MatrixAddFusion: " << rewrites << " rewrite(s), "
+            << removed_.size() << " node(s) removed";
+    return Status::OK();
+  }
+
+  void Feedback(Cluster* cluster, const GrapplerItem& item,
+                const GraphDef& optimized_graph, double result) override {}
+
+ private:
+  // every rewrite starts from a "MatrixAdd" or a "MatrixAddN"
+  static bool ContainsMatrixAdd(const GraphDef& graph) {
+    for (const NodeDef& node : graph.node())
+      if (IsMatrixAdd(node) || IsMatrixAddN(node))
+        return true;
+    return false;
+  }
+
+  string Activation(const NodeDef& node) const {
+    auto it = node.attr().find("activation");
+    return it == node.attr().end() ? "none" : it->second.s();
+  }
+
+  float Scale(const NodeDef& node) const {
+    auto it = node.attr().find("scale");
+    return it == node.attr().end() ? 1.f : it->second.f();
+  }
+
+  // producer of the data input "input" of "consumer", if it can be
+  // folded into "consumer"
+  NodeDef* Foldable(const NodeDef& consumer, const string& input) {
+    if (IsControlInput(input))
+      return nullptr;
+    auto it = nodes_.find(NodeName(input));
+    if (it == nodes_.end())
+      return nullptr;
+    NodeDef* producer = it->second;
+    if (!IsMatrixAdd(*producer) && !IsMatrixAddN(*producer))
+      return nullptr;
+    if (Activation(*producer) != "none" || Scale(*producer) != 1 ||
+        fanout_[producer->name()] != 1 ||
+        preserve_.count(producer->name()) != 0 ||
+        HasControlInputs(*producer) ||
+        producer->device() != consumer.device() ||
+        producer->attr().at("T").type() != consumer.attr().at("T").type())
+      return nullptr;
+    return producer;
+  }
+
+  // MatrixAdd(MatrixAdd(A, B), C) -> MatrixAddN(A, B, C)
+  int FuseSum(NodeDef* node) {
+    if (Activation(*node) != "none" || Scale(*node) != 1 || flat_.count(node->name()) == 0 ||
+        HasControlInputs(*node))
+      return 0;
+
+    std::vector<string> inputs;
+    float bias = node->attr().at("bias").f();
+    for (const string& input : node->input()) {
+      NodeDef* producer = Foldable(*node, input);
+      if (producer == nullptr || flat_.count(producer->name()) == 0) {
+        inputs.push_back(input);
+        continue;
+      }
+      for (const string& producer_input : producer->input())
+        inputs.push_back(producer_input);
+      bias += producer->attr().at("bias").f();
+      removed_.insert(producer->name());
+    }
+    if (inputs.size() == 2)
+      return 0;
+
+    const DataType type = node->attr().at("T").type();
+    node->set_op("MatrixAddN");
+    node->clear_input();
+    for (const string& input : inputs)
+      node->add_input(input);
+    node->clear_attr();
+    (*node->mutable_attr())["T"].set_type(type);
+    (*node->mutable_attr())["N"].set_i(inputs.size());
+    (*node->mutable_attr())["bias"].set_f(bias);
+    return 1;
+  }
+
+  // Relu(MatrixAdd(A, B)) -> MatrixAdd(A, B, activation='relu')
+  int FuseRelu(NodeDef* node) {
+    if (node->input_size() != 1 || HasControlInputs(*node))
+      return 0;
+    NodeDef* producer = Foldable(*node, node->input(0));
+    if (producer == nullptr || producer->input_size() < 2)
+      return 0;
+
+    const DataType type = node->attr().at("T").type();
+    float bias = producer->attr().at("bias").f();
+    node->set_op("MatrixAdd");
+    node->clear_input();
+    if (producer->input_size() == 2) {
+      node->add_input(producer->input(0));
+      node->add_input(producer->input(1));
+      removed_.insert(producer->name());
+    } else {
+      // the last input moves to the consumer, which applies the
+      // activation, the remaining ones stay in "MatrixAddN"
+      const int N = producer->input_size();
+      node->add_input(producer->name());
+      node->add_input(producer->input(N - 1));
+      producer->mutable_input()->RemoveLast();
+      (*producer->mutable_attr())["N"].set_i(N - 1);
+      bias = 0.f;
+    }
+    node->clear_attr();
+    (*node->mutable_attr())["T"].set_type(type);
+    (*node->mutable_attr())["bias"].set_f(bias);
+    (*node->mutable_attr())["activation"].set_s("relu");
+    (*node->mutable_attr())["alpha"].set_f(0.2f);
+    (*node->mutable_attr())["scale"].set_f(1.f);
+    return 1;
+  }
+
+  std::unordered_set<string> preserve_;
+  std::unordered_map<string, NodeDef*> nodes_;
+  std::unordered_map<string, int> fanout_;
+  std::unordered_set<string> flat_;
+  std::unordered_set<string> removed_;
+};
+
+REGISTER_GRAPPLER_OPTIMIZER(MatrixAddFusion, "MatrixAddFusion");
+
+}  // namespace grappler
+}  // namespace tensorflow
@@ -0,0 +1,106 @@
+// ComputerGraphics Tuebingen, 2018
+
+#ifndef MATRIX_ADD_KERNELS_MATRIX_ADD_TRACE_H_
+#define MATRIX_ADD_KERNELS_MATRIX_ADD_TRACE_H_
+
+// Instrumentation of the ops, which is only compiled in when building with
+// "cmake -DMATRIX_ADD_TRACING=ON". Otherwise all macros below expand to
+// nothing and cost nothing.
+//
+//   MATRIX_ADD_TRACE(op, variant, output, bytes)
+//     host side scope (shows up in the TF timeline) labeled with shape,
+//     dtype, bytes moved and the kernel variant, also updates the
+//     monitoring counters "/matrix_add/{calls,bytes,time_us}" per op
+//   MATRIX_ADD_NVTX_RANGE(name)
+//     NVTX range around CUDA launches (shows up in nvprof / Nsight)
+
+#if MATRIX_ADD_TRACING
+
+#if GOOGLE_CUDA
+#include <nvToolsExt.h>
+#endif
+
+#if !defined(__CUDACC__)
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/lib/monitoring/counter.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/tracing.h"
+#endif
+
+namespace tensorflow {
+namespace functor {
+
+#if !defined(__CUDACC__)
+struct TraceCounters {
+  monitoring::Counter<1>* calls;
+  monitoring::Counter<1>* bytes;
+  monitoring::Counter<1>* time_us;
+
+  static const TraceCounters& Get() {
+    static const TraceCounters counters = {
+      monitoring::Counter<1>::New("/matrix_add/calls",
+                                  "Number of calls.", "op"),
+      monitoring::Counter<1>::New("/matrix_add/bytes",
+                                  "Bytes read and written by the kernels.", "op"),
+      monitoring::Counter<1>::New("/matrix_add/time_us",
+                                  "Cumulative time in Compute (host side) in microseconds.", "op")};
+    return counters;
+  }
+};
+
+// For GPU ops the measured time is the time to enqueue the kernels.
+class OpTrace {
+ public:
+  OpTrace(const char* op, const char* variant, const Tensor& output, int64 bytes)
+    : op_(op), bytes_(bytes), start_us_(Env::Default()->NowMicros()),
+      trace_(op, strings::StrCat("shape=", output.shape().DebugString(),
+                                 ",dtype=", DataTypeString(output.dtype()),
+                                 ",bytes=", bytes,
+                                 ",variant=", variant)) {}
+
+  ~OpTrace() {
+    const TraceCounters& counters = TraceCounters::Get();
+    counters.calls->GetCell(op_)->IncrementBy(1);
+    counters.bytes->GetCell(op_)->IncrementBy(bytes_);
+    counters.time_us->GetCell(op_)->IncrementBy(Env::Default()->NowMicros() - start_us_);
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(OpTrace);
+  const char* op_;
+  const int64 bytes_;
+  const uint64 start_us_;
+  port::Tracing::TraceMe trace_;
+};
+#endif
+
+#if GOOGLE_CUDA
+class NvtxRange {
+ public:
+  explicit NvtxRange(const char* name) { nvtxRangePushA(name); }
+  ~NvtxRange() { nvtxRangePop(); }
+
+ private:
+  NvtxRange(const NvtxRange&) = delete;
+  void operator=(const NvtxRange&) = delete;
+};
+#endif
+
+}  // namespace functor
+}  // namespace tensorflow
+
+#define MATRIX_ADD_TRACE(op, variant, output, bytes) \
+  ::tensorflow::functor::OpTrace matrix_add_trace_(op, variant, output, bytes)
+#define MATRIX_ADD_NVTX_RANGE(name) \
+  ::tensorflow::functor::NvtxRange matrix_add_nvtx_range_(name)
+
+#else
+
+#define MATRIX_ADD_TRACE(op, variant, output, bytes)
+#define MATRIX_ADD_NVTX_RANGE(name)
+
+#endif  // MATRIX_ADD_TRACING
+
+#endif  // MATRIX_ADD_KERNELS_MATRIX_ADD_TRACE_H_
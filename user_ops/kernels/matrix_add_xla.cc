@@ -0,0 +1,185 @@
+// ComputerGraphics Tuebingen, 2018
+
+// XLA lowering of "MatrixAdd" and "MatrixAddGrad", only compiled when
+// building with "cmake -DMATRIX_ADD_XLA=ON" against a TensorFlow with XLA.
+//
+// Inside a JIT cluster (auto-clustering or "jit_scope") the ops are expanded
+// to plain HLO (broadcast, add, activation, reduce), which XLA fuses with the
+// neighboring elementwise ops and reductions instead of splitting the
+// cluster. Half and bfloat16 are computed in float like the native kernels.
+
+#include "tensorflow/compiler/tf2xla/xla_helpers.h"
+#include "tensorflow/compiler/tf2xla/xla_op_kernel.h"
+#include "tensorflow/compiler/tf2xla/xla_op_registry.h"
+#include "tensorflow/compiler/xla/client/xla_client/xla_builder.h"
+#include "tensorflow/core/util/bcast.h"
+
+namespace tensorflow {
+
+namespace {
+
+// reads the attributes of the fused epilogue (see "GetEpilogueAttrs")
+void GetEpilogueAttrs(XlaOpKernelConstruction* ctx, string* activation, float* alpha,
+                      float* scale) {
+  OP_REQUIRES_OK(ctx, ctx->GetAttr("activation", activation));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr("alpha", alpha));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr("scale", scale));
+  OP_REQUIRES(ctx, *alpha >= 0,
+              errors::InvalidArgument("alpha must be non-negative, got ", *alpha));
+}
+
+// broadcasts "A" and "B" against each other and returns
+// "scale * (A + B) + bias" in the type "type" and the shape of the output
+xla::XlaOp BroadcastSum(XlaOpKernelContext* ctx, const BCast& bcast,
+                        DataType type, float scale, float bias) {
+  xla::XlaBuilder* b = ctx->builder();
+  xla::XlaOp mA = XlaHelpers::ConvertElementType(b, ctx->Input(0), type);
+  xla::XlaOp mB = XlaHelpers::ConvertElementType(b, ctx->Input(1), type);
+
+  // both operands have the (collapsed) rank of the result, dimensions of
+  // size 1 are broadcasted implicitly
+  xla::XlaOp sum = b->Add(b->Reshape(mA, bcast.x_reshape()),
+                          b->Reshape(mB, bcast.y_reshape()));
+  sum = b->Reshape(sum, bcast.output_shape());
+  if (scale != 1)
+    sum = b->Mul(sum, XlaHelpers::FloatLiteral(b, type, scale));
+  return b->Add(sum, XlaHelpers::FloatLiteral(b, type, bias));
+}
+
+xla::XlaOp Activate(xla::XlaBuilder* b, xla::XlaOp x, DataType type,
+                    const string& activation, float alpha) {
+  if (activation == "relu")
+    return b->Max(x, XlaHelpers::Zero(b, type));
+  if (activation == "leaky_relu")
+    return b->Select(b->Gt(x, XlaHelpers::Zero(b, type)), x,
+                     b->Mul(x, XlaHelpers::FloatLiteral(b, type, alpha)));
+  if (activation == "gelu") {
+    // same tanh approximation as "ActivationFn<Activation::kGelu>"
+    auto c = [&](double v) { return XlaHelpers::FloatLiteral(b, type, v); };
+    xla::XlaOp inner = b->Mul(c(0.7978845608028654),
+                              b->Add(x, b->Mul(c(0.044715), b->Mul(x, b->Mul(x, x)))));
+    return b->Mul(b->Mul(c(0.5), x), b->Add(c(1), b->Tanh(inner)));
+  }
+  return x;
+}
+
+// gradient w.r.t. "x" given the incoming gradient "g", "y" = activation(x)
+xla::XlaOp ActivateGrad(xla::XlaBuilder* b, xla::XlaOp g, xla::XlaOp x, xla::XlaOp y,
+                        DataType type, const string& activation, float alpha) {
+  xla::XlaOp positive = b->Gt(y, XlaHelpers::Zero(b, type));
+  if (activation == "relu")
+    return b->Select(positive, g, XlaHelpers::Zero(b, type));
+  if (activation == "leaky_relu")
+    return b->Select(positive, g, b->Mul(g, XlaHelpers::FloatLiteral(b, type, alpha)));
+  if (activation == "gelu") {
+    auto c = [&](double v) { return XlaHelpers::FloatLiteral(b, type, v); };
+    xla::XlaOp x2 = b->Mul(x, x);
+    xla::XlaOp t = b->Tanh(b->Mul(c(0.7978845608028654),
+                                  b->Add(x, b->Mul(c(0.044715), b->Mul(x, x2)))));
+    xla::XlaOp dinner = b->Mul(c(0.7978845608028654),
+                               b->Add(c(1), b->Mul(c(3 * 0.044715), x2)));
+    xla::XlaOp dgelu = b->Add(b->Mul(c(0.5), b->Add(c(1), t)),
+                              b->Mul(b->Mul(c(0.5), x),
+                                     b->Mul(b->Sub(c(1), b->Mul(t, t)), dinner)));
+    return b->Mul(g, dgelu);
+  }
+  return g;
+}
+
+}  // namespace
+
+// Forward-Pass (XLA)
+// --------------------------------------------------
+class MatrixAddXlaOp : public XlaOpKernel {
+ public:
+  explicit MatrixAddXlaOp(XlaOpKernelConstruction* ctx) : XlaOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("bias", &bias_));
+    GetEpilogueAttrs(ctx, &activation_, &alpha_, &scale_);
+  }
+
+  void Compile(XlaOpKernelContext* ctx) override {
+    const TensorShape shape_a = ctx->InputShape(0);
+    const TensorShape shape_b = ctx->InputShape(1);
+    BCast bcast(BCast::FromShape(shape_a), BCast::FromShape(shape_b));
+    OP_REQUIRES(ctx, bcast.IsValid(),
+                errors::InvalidArgument("Incompatible shapes: ", shape_a.DebugString(),
+                                        " vs. ", shape_b.DebugString()));
+
+    xla::XlaBuilder* b = ctx->builder();
+    const DataType type = ctx->input_type(0);
+    const DataType compute_type = XlaHelpers::SumAccumulationType(type);
+
+    xla::XlaOp x = BroadcastSum(ctx, bcast, compute_type, scale_, bias_);
+    xla::XlaOp y = Activate(b, x, compute_type, activation_, alpha_);
+    ctx->SetOutput(0, XlaHelpers::ConvertElementType(b, y, type));
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddXlaOp);
+  float bias_;
+  string activation_;
+  float alpha_;
+  float scale_;
+};
+
+// Backward-Pass (XLA)
+// --------------------------------------------------
+// "copy_gradients" has no meaning here, XLA assigns the buffers itself.
+class MatrixAddGradXlaOp : public XlaOpKernel {
+ public:
+  explicit MatrixAddGradXlaOp(XlaOpKernelConstruction* ctx) : XlaOpKernel(ctx) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("bias", &bias_));
+    GetEpilogueAttrs(ctx, &activation_, &alpha_, &scale_);
+  }
+
+  void Compile(XlaOpKernelContext* ctx) override {
+    const TensorShape shape_a = ctx->InputShape(0);
+    const TensorShape shape_b = ctx->InputShape(1);
+    BCast bcast(BCast::FromShape(shape_a), BCast::FromShape(shape_b));
+    OP_REQUIRES(ctx, bcast.IsValid(),
+                errors::InvalidArgument("Incompatible shapes: ", shape_a.DebugString(),
+                                        " vs. ", shape_b.DebugString()));
+    OP_REQUIRES(ctx, BCast::ToShape(bcast.output_shape()) == ctx->InputShape(2) &&
+                     ctx->InputShape(3) == ctx->InputShape(2),
+                errors::InvalidArgument("Gradients must have the shape of the output"));
+
+    xla::XlaBuilder* b = ctx->builder();
+    const DataType type = ctx->input_type(0);
+    const DataType compute_type = XlaHelpers::SumAccumulationType(type);
+
+    xla::XlaOp topdiff = XlaHelpers::ConvertElementType(b, ctx->Input(2), compute_type);
+    if (activation_ != "none") {
+      // only "gelu" needs the input of the activation, XLA removes the
+      // unused sum otherwise
+      xla::XlaOp x = BroadcastSum(ctx, bcast, compute_type, scale_, bias_);
+      xla::XlaOp y = XlaHelpers::ConvertElementType(b, ctx->Input(3), compute_type);
+      topdiff = ActivateGrad(b, topdiff, x, y, compute_type, activation_, alpha_);
+    }
+    if (scale_ != 1)
+      topdiff = b->Mul(topdiff, XlaHelpers::FloatLiteral(b, compute_type, scale_));
+
+    // sum over the broadcasted axes of each input
+    const BCast::Vec* reduce_idx[2] = {&bcast.grad_x_reduce_idx(), &bcast.grad_y_reduce_idx()};
+    const TensorShape* input_shape[2] = {&shape_a, &shape_b};
+    for (int i = 0; i < 2; ++i) {
+      xla::XlaOp grad = topdiff;
+      if (!reduce_idx[i]->empty())
+        grad = b->Reduce(grad, XlaHelpers::Zero(b, compute_type),
+                         *ctx->GetOrCreateAdd(compute_type), *reduce_idx[i]);
+      grad = b->Reshape(grad, input_shape[i]->dim_sizes());
+      ctx->SetOutput(i, XlaHelpers::ConvertElementType(b, grad, type));
+    }
+  }
+
+ private:
+  TF_DISALLOW_COPY_AND_ASSIGN(MatrixAddGradXlaOp);
+  float bias_;
+  string activation_;
+  float alpha_;
+  float scale_;
+};
+
+REGISTER_XLA_OP(Name("MatrixAdd"), MatrixAddXlaOp);
+REGISTER_XLA_OP(Name("MatrixAddGrad"), MatrixAddGradXlaOp);
+
+}  // namespace tensorflow
@@ -1,5 +1,6 @@
 // ComputerGraphics Tuebingen, 2017
 
+#include "tensorflow/core/framework/common_shape_fns.h"
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/shape_inference.h"
 
@@ -18,30 +19,17 @@ Status UnchangedShape(InferenceContext* c) {
 
 REGISTER_OP("MatrixAdd")
 .Attr("bias: float")
+.Attr("activation: {'none', 'relu', 'leaky_relu', 'gelu'} = 'none'")
+.Attr("alpha: float = 0.2")
+.Attr("scale: float = 1")
 .Attr("T: realnumbertype")
 .Input("matrix_a: T")
 .Input("matrix_b: T")
 .Output("output: T")
 .SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
-  // we require the input to have 4 axes
-  ShapeHandle shape_hnd;
-  TF_RETURN_IF_ERROR(c->WithRank(c->input(0), 4, &shape_hnd));
-  TF_RETURN_IF_ERROR(c->WithRank(c->input(1), 4, &shape_hnd));
-
-  ShapeHandle matrix_a_shape = c->input(0);
-  ShapeHandle matrix_b_shape = c->input(1);
-
-  // assert shapes of matrix_a and matrix_b are matching
-  TF_RETURN_IF_ERROR(c->Merge(matrix_a_shape, matrix_b_shape, &matrix_a_shape));
-
-  // specify output-shape
-  // this could be "c->set_output(0, matrix_a_shape);"
-  // but we do it explicitly
-  auto B = c->Dim(c->input(0), 0);
-  auto M = c->Dim(c->input(0), 1);
-  auto N = c->Dim(c->input(0), 2);
-  auto D = c->Dim(c->input(0), 3);
-  c->set_output(0, c->MakeShape({B, M, N, D}));
+  // inputs of any rank are accepted, numpy-style broadcasting of matrix_a
+  // and matrix_b (e.g. a per-channel [1, 1, 1, D] term) gives the output-shape
+  TF_RETURN_IF_ERROR(::tensorflow::shape_inference::BroadcastBinaryOpShapeFn(c));
 
   // we can also use the Attr here
   float bias;
@@ -52,19 +40,28 @@ REGISTER_OP("MatrixAdd")
 .Doc(R"doc(
 Add two matrices and a constant
 
-This computes `A`+`B`+`bias` for two matrices.
+This computes `activation(scale`*(`A`+`B`)+`bias)` for two matrices. The
+inputs can have any rank and are broadcasted against each other like in numpy.
 
-matrix_a: A batch of matrices [B, M, N, D].
-matrix_b: A batch of matrices [B, M, N, D].
-output: A batch of matrices [B, M, N, D] containing the result.
+matrix_a: A batch of matrices, e.g. [B, M, N, D] (or broadcastable to it).
+matrix_b: A batch of matrices, e.g. [B, M, N, D] (or broadcastable to it).
+output: A batch of matrices containing the result.
 bias: An additional constant term.
+activation: Elementwise activation fused into the kernel.
+alpha: Slope of `leaky_relu` for negative values (non-negative).
+scale: Factor of the sum, applied before the bias and the activation.
 )doc");
 
 REGISTER_OP("MatrixAddGrad")
 .Attr("bias: float")
+.Attr("activation: {'none', 'relu', 'leaky_relu', 'gelu'} = 'none'")
+.Attr("alpha: float = 0.2")
+.Attr("scale: float = 1")
+.Attr("copy_gradients: bool = false")
 .Input("matrix_a: T")
 .Input("matrix_b: T")
 .Input("gradients: T")
+.Input("output: T")
 .Output("grad_matrix_a: T")
 .Output("grad_matrix_b: T")
 .Attr("T: realnumbertype")
@@ -74,7 +71,225 @@ REGISTER_OP("MatrixAddGrad")
   return ::tensorflow::Status::OK();
 })
 .Doc(R"doc(
-Returns gradients of "matrix_a + matrix_b + bias".
+Returns gradients of "activation(scale * (matrix_a + matrix_b) + bias)".
+
+The forward result `output` is used to backprop through the activation.
+Gradients of broadcasted inputs are summed over the broadcasted axes.
+
+copy_gradients: By default both outputs share the buffer of `gradients`.
+  Set this to true if separate storage is required.
+)doc");
+
+REGISTER_OP("MatrixAddV2")
+.Attr("activation: {'none', 'relu', 'leaky_relu', 'gelu'} = 'none'")
+.Attr("alpha: float = 0.2")
+.Attr("scale: float = 1")
+.Attr("T: realnumbertype")
+.Input("matrix_a: T")
+.Input("matrix_b: T")
+.Input("bias: T")
+.Output("output: T")
+.SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+  TF_RETURN_IF_ERROR(::tensorflow::shape_inference::BroadcastBinaryOpShapeFn(c));
+
+  // a scalar or one value per channel (the last axis of the output)
+  ShapeHandle bias = c->input(2);
+  TF_RETURN_IF_ERROR(c->WithRankAtMost(bias, 1, &bias));
+  ShapeHandle output = c->output(0);
+  if (c->RankKnown(bias) && c->Rank(bias) == 1 && c->RankKnown(output) &&
+      c->Rank(output) >= 1) {
+    ::tensorflow::shape_inference::DimensionHandle channels = c->Dim(bias, 0);
+    if (!c->ValueKnown(channels) || c->Value(channels) != 1)
+      TF_RETURN_IF_ERROR(c->Merge(channels, c->Dim(output, -1), &channels));
+  }
+  return Status::OK();
+})
+.Doc(R"doc(
+Add two matrices and a bias tensor
+
+Same as `MatrixAdd`, but the bias is an input instead of an attribute. It is
+either a single value or one value per channel (the last axis of the output)
+and its gradient is returned by `MatrixAddV2Grad`.
+
+bias: A scalar, [1] or [D] where D is the size of the last output axis.
+)doc");
+
+REGISTER_OP("MatrixAddV2Grad")
+.Attr("activation: {'none', 'relu', 'leaky_relu', 'gelu'} = 'none'")
+.Attr("alpha: float = 0.2")
+.Attr("scale: float = 1")
+.Attr("copy_gradients: bool = false")
+.Input("matrix_a: T")
+.Input("matrix_b: T")
+.Input("bias: T")
+.Input("gradients: T")
+.Input("output: T")
+.Output("grad_matrix_a: T")
+.Output("grad_matrix_b: T")
+.Output("grad_bias: T")
+.Attr("T: realnumbertype")
+.SetShapeFn([](InferenceContext* c) {
+  c->set_output(0, c->input(0));
+  c->set_output(1, c->input(1));
+  c->set_output(2, c->input(2));
+  return ::tensorflow::Status::OK();
+})
+.Doc(R"doc(
+Returns gradients of "activation(scale * (matrix_a + matrix_b) + bias)" for
+`MatrixAddV2`.
+
+The gradient of `bias` is summed over all axes it is broadcasted along.
+
+copy_gradients: By default the gradients of `matrix_a` and `matrix_b` share
+  the buffer of `gradients`. Set this to true if separate storage is required.
+)doc");
+
+REGISTER_OP("MatrixAddSparseGrad")
+.Attr("bias: float")
+.Attr("activation: {'none', 'relu', 'leaky_relu', 'gelu'} = 'none'")
+.Attr("alpha: float = 0.2")
+.Attr("scale: float = 1")
+.Attr("T: {half, bfloat16, float, double}")
+.Attr("Tindices: {int32, int64}")
+.Input("gradients: T")
+.Input("indices: Tindices")
+.Input("matrix_a: T")
+.Input("matrix_b: T")
+.Input("output: T")
+.Output("grad_values: T")
+.SetShapeFn([](InferenceContext* c) {
+  c->set_output(0, c->input(0));
+  return ::tensorflow::Status::OK();
+})
+.Doc(R"doc(
+Returns sparse gradients of "activation(scale * (matrix_a + matrix_b) + bias)".
+
+Like `MatrixAddGrad` for a gradient given as IndexedSlices, i.e. row k of
+`gradients` belongs to row `indices[k]` of `output`. Only these rows are
+backpropagated through the activation. The result holds the values of the
+IndexedSlices gradient of both inputs (which must have the output-shape).
+
+gradients: The values of the gradient, [K, ...].
+indices: The rows of `output` the values belong to, [K].
+grad_values: The values of the gradient of `matrix_a` and `matrix_b`.
+)doc");
+
+REGISTER_OP("MatrixAddN")
+.Attr("bias: float")
+.Attr("N: int >= 1")
+.Attr("T: realnumbertype")
+.Input("inputs: N * T")
+.Output("output: T")
+.SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+  ShapeHandle output_shape = c->input(0);
+
+  // all inputs must have the same shape (of any rank)
+  for (int i = 1; i < c->num_inputs(); ++i)
+    TF_RETURN_IF_ERROR(c->Merge(output_shape, c->input(i), &output_shape));
+
+  c->set_output(0, output_shape);
+  return Status::OK();
+})
+.Doc(R"doc(
+Add several matrices and a constant
+
+This computes `inputs[0]`+...+`inputs[N-1]`+`bias` in a single pass over
+the memory instead of chaining N-1 `MatrixAdd` ops.
+
+inputs: A list of batches of matrices of the same shape (of any rank).
+output: A batch of matrices containing the result.
+bias: An additional constant term.
+)doc");
+
+REGISTER_OP("MatrixAddGrouped")
+.Attr("bias: float")
+.Attr("N: int >= 1")
+.Attr("T: realnumbertype")
+.Input("matrix_a: N * T")
+.Input("matrix_b: N * T")
+.Output("output: N * T")
+.SetShapeFn([](::tensorflow::shape_inference::InferenceContext* c) {
+  const int num_groups = c->num_outputs();
+
+  // both inputs of a group must have the same shape
+  for (int k = 0; k < num_groups; ++k) {
+    ShapeHandle output_shape;
+    TF_RETURN_IF_ERROR(c->Merge(c->input(k), c->input(num_groups + k), &output_shape));
+    c->set_output(k, output_shape);
+  }
+  return Status::OK();
+})
+.Doc(R"doc(
+Add many pairs of matrices and a constant
+
+This computes `matrix_a[k]`+`matrix_b[k]`+`bias` for all k. In contrast to
+N separate `MatrixAdd` ops all pairs are processed by a single kernel launch,
+which pays off for many tiny tensors where the launch overhead dominates.
+
+matrix_a: A list of tensors (of any shape).
+matrix_b: A list of tensors, matrix_b[k] has the shape of matrix_a[k].
+output: The list of results, output[k] has the shape of matrix_a[k].
+bias: An additional constant term.
+)doc");
+
+REGISTER_OP("MatrixAddNGrad")
+.Attr("N: int >= 1")
+.Attr("copy_gradients: bool = false")
+.Input("gradients: T")
+.Output("grad_inputs: N * T")
+.Attr("T: realnumbertype")
+.SetShapeFn([](InferenceContext* c) {
+  for (int i = 0; i < c->num_outputs(); ++i)
+    c->set_output(i, c->input(0));
+  return ::tensorflow::Status::OK();
+})
+.Doc(R"doc(
+Returns gradients of "inputs[0] + ... + inputs[N-1] + bias".
+
+copy_gradients: By default all outputs share the buffer of `gradients`.
+  Set this to true if separate storage is required.
+)doc");
+
+
+REGISTER_OP("QuantizedMatrixAdd")
+.Attr("bias: float = 0")
+.Attr("activation: {'none', 'relu'} = 'none'")
+.Attr("T: {qint8, quint8}")
+.Input("matrix_a: T")
+.Input("matrix_b: T")
+.Input("min_a: float")
+.Input("max_a: float")
+.Input("min_b: float")
+.Input("max_b: float")
+.Input("min_output: float")
+.Input("max_output: float")
+.Output("output: T")
+.Output("output_min: float")
+.Output("output_max: float")
+.SetShapeFn([](InferenceContext* c) {
+  TF_RETURN_IF_ERROR(::tensorflow::shape_inference::BroadcastBinaryOpShapeFn(c));
+  ShapeHandle unused;
+  for (int i = 2; i < 8; ++i)
+    TF_RETURN_IF_ERROR(c->WithRank(c->input(i), 0, &unused));
+  c->set_output(1, c->Scalar());
+  c->set_output(2, c->Scalar());
+  return Status::OK();
+})
+.Doc(R"doc(
+Add two quantized matrices and a constant
+
+This computes `activation(A`+`B`+`bias)` of the real values of `matrix_a`
+and `matrix_b` (quantized in the ranges [min_a, max_a] and [min_b, max_b]
+like `Dequantize` in MIN_COMBINED mode) and quantizes the result into the
+range [min_output, max_output]. The rescaling is done in fixed point, the
+inputs are never dequantized. Values outside the output range saturate.
+
+min_output: Lower bound of the output range, e.g. as calibrated for the graph.
+max_output: Upper bound of the output range.
+output_min: Same as `min_output`.
+output_max: Same as `max_output`.
+bias: An additional constant term (a real value).
+activation: Elementwise activation fused into the kernel.
 )doc");
 
 
@@ -3,11 +3,32 @@
 
 import numpy as np
 import tensorflow as tf
-from __init__ import matrix_add
+from __init__ import (load_library, matrix_add, matrix_add_grouped, matrix_add_host_a, matrix_add_n,
+                      matrix_add_optimizer_config, matrix_add_v2, matrix_maximum,
+                      matrix_minimum, matrix_mul, matrix_sub, quantized_matrix_add)
 
 np.random.seed(42)
 tf.set_random_seed(42)
 
+# ops stamped out from the elementwise engine and their numpy reference
+ELEMENTWISE_OPS = [(matrix_sub, np.subtract),
+                   (matrix_mul, np.multiply),
+                   (matrix_minimum, np.minimum),
+                   (matrix_maximum, np.maximum)]
+
+# pairs of input shapes which are not both of rank 4
+RANK_SHAPES = [((7,), (7,)),
+               ((3, 4), (3, 4)),
+               ((3, 4), (1, 3, 4)),
+               ((2, 3, 4), (4,)),
+               ((), (2, 3)),
+               ((2, 1, 3, 1, 2, 2), (1, 4, 1, 2, 1, 1)),
+               # broadcasted although both inputs have the same size
+               ((6,), (6, 1)),
+               ((6, 1), (6,)),
+               ((1, 6), (6, 1)),
+               ((6, 1), (1, 6))]
+
 
 class MatrixAddtest(tf.test.TestCase):
 
@@ -40,6 +61,30 @@ class MatrixAddtest(tf.test.TestCase):
         self._forward(use_gpu=False, force_gpu=False, dtype=np.float64)
         self._forward(use_gpu=True, force_gpu=True, dtype=np.float64)
 
+    def test_forward_half(self):
+        self._forward(use_gpu=False, force_gpu=False, dtype=np.float16)
+        self._forward(use_gpu=True, force_gpu=True, dtype=np.float16)
+
+    def _forward_bfloat16(self, use_gpu=False, force_gpu=False):
+        matA = np.random.randn(1, 2, 3, 4).astype(np.float32)
+        matB = np.random.randn(1, 2, 3, 4).astype(np.float32)
+        bias = 2.
+
+        expected = matA + matB + bias
+
+        matA_op = tf.cast(tf.convert_to_tensor(matA), tf.bfloat16)
+        matB_op = tf.cast(tf.convert_to_tensor(matB), tf.bfloat16)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = tf.cast(matrix_add(matA_op, matB_op, bias), tf.float32)
+            actual = sess.run(actual_op)
+
+        self.assertAllClose(expected, actual, rtol=5e-2, atol=5e-2)
+
+    def test_forward_bfloat16(self):
+        self._forward_bfloat16(use_gpu=False, force_gpu=False)
+        self._forward_bfloat16(use_gpu=True, force_gpu=True)
+
     def _backward(self, use_gpu=False, force_gpu=False, dtype=np.float32):
         matA = np.random.randn(1, 2, 3, 4).astype(dtype) * 10
         matB = np.random.randn(1, 2, 3, 4).astype(dtype) * 10
@@ -66,6 +111,531 @@ class MatrixAddtest(tf.test.TestCase):
         self._backward(use_gpu=False, force_gpu=False, dtype=np.float64)
         self._backward(use_gpu=True, force_gpu=True, dtype=np.float64)
 
+    def _forward_broadcast(self, shape_b, use_gpu=False, force_gpu=False, dtype=np.float32,
+                           shape_a=(2, 3, 4, 5)):
+        matA = np.asarray(np.random.randn(*shape_a)).astype(dtype) * 10
+        matB = np.asarray(np.random.randn(*shape_b)).astype(dtype) * 10
+        bias = 42.
+
+        expected = matA + matB + bias
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = matrix_add(matA_op, matB_op, bias)
+            actual = sess.run(actual_op)
+
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose(expected, actual)
+
+    def test_forward_broadcast(self):
+        for shape_b in [(1, 1, 1, 5), (2, 1, 1, 1), (1, 3, 1, 5)]:
+            self._forward_broadcast(shape_b, use_gpu=False, force_gpu=False)
+            self._forward_broadcast(shape_b, use_gpu=True, force_gpu=True)
+
+    def _backward_broadcast(self, shape_b, use_gpu=False, force_gpu=False, dtype=np.float32,
+                            shape_a=(2, 3, 4, 5)):
+        matA = np.asarray(np.random.randn(*shape_a)).astype(dtype) * 10
+        matB = np.asarray(np.random.randn(*shape_b)).astype(dtype) * 10
+        bias = 42.
+
+        expected = (matA + matB + bias).astype(np.float32)
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_op = matrix_add(matA_op, matB_op, bias)
+            err = tf.test.compute_gradient_error(
+                [matA_op, matB_op], [matA.shape, matB.shape],
+                actual_op, expected.shape)
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_broadcast(self):
+        for shape_b in [(1, 1, 1, 5), (2, 1, 1, 1), (1, 3, 1, 5)]:
+            self._backward_broadcast(shape_b, use_gpu=False, force_gpu=False, dtype=np.float64)
+            self._backward_broadcast(shape_b, use_gpu=True, force_gpu=True, dtype=np.float64)
+
+    def test_forward_rank(self):
+        for shape_a, shape_b in RANK_SHAPES:
+            self._forward_broadcast(shape_b, use_gpu=False, force_gpu=False, shape_a=shape_a)
+            self._forward_broadcast(shape_b, use_gpu=True, force_gpu=True, shape_a=shape_a)
+
+    def test_backward_rank(self):
+        for shape_a, shape_b in RANK_SHAPES:
+            self._backward_broadcast(shape_b, use_gpu=False, force_gpu=False, dtype=np.float64,
+                                     shape_a=shape_a)
+            self._backward_broadcast(shape_b, use_gpu=True, force_gpu=True, dtype=np.float64,
+                                     shape_a=shape_a)
+
+    def _forward_n(self, num_inputs, use_gpu=False, force_gpu=False, dtype=np.float32):
+        mats = [np.random.randn(2, 3, 4, 5).astype(dtype) * 10 for _ in range(num_inputs)]
+        bias = 42.
+
+        expected = sum(mats) + bias
+
+        mat_ops = [tf.convert_to_tensor(m) for m in mats]
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = matrix_add_n(mat_ops, bias)
+            actual = sess.run(actual_op)
+
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose(expected, actual)
+
+    def test_forward_n(self):
+        # more than 8 inputs need several passes on the GPU
+        for num_inputs in [1, 2, 5, 11]:
+            self._forward_n(num_inputs, use_gpu=False, force_gpu=False)
+            self._forward_n(num_inputs, use_gpu=True, force_gpu=True)
+
+    def _backward_n(self, num_inputs, use_gpu=False, force_gpu=False, dtype=np.float64):
+        mats = [np.random.randn(2, 3, 4, 5).astype(dtype) * 10 for _ in range(num_inputs)]
+        bias = 42.
+
+        expected = sum(mats) + bias
+
+        mat_ops = [tf.convert_to_tensor(m) for m in mats]
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_op = matrix_add_n(mat_ops, bias)
+            err = tf.test.compute_gradient_error(
+                mat_ops, [m.shape for m in mats],
+                actual_op, expected.shape)
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_n(self):
+        self._backward_n(3, use_gpu=False, force_gpu=False)
+        self._backward_n(3, use_gpu=True, force_gpu=True)
+
+    def _grouped_shapes(self, num_groups):
+        # tiny tensors of different sizes, including empty ones
+        return [(k % 7, 3, 5) for k in range(num_groups)]
+
+    def _forward_grouped(self, num_groups, use_gpu=False, force_gpu=False, dtype=np.float32):
+        shapes = self._grouped_shapes(num_groups)
+        matsA = [np.random.randn(*shape).astype(dtype) * 10 for shape in shapes]
+        matsB = [np.random.randn(*shape).astype(dtype) * 10 for shape in shapes]
+        bias = 42.
+
+        matA_ops = [tf.convert_to_tensor(m) for m in matsA]
+        matB_ops = [tf.convert_to_tensor(m) for m in matsB]
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_ops = matrix_add_grouped(matA_ops, matB_ops, bias)
+            actuals = sess.run(actual_ops)
+
+        for a, b, actual_op, actual in zip(matsA, matsB, actual_ops, actuals):
+            self.assertShapeEqual(a, actual_op)
+            self.assertAllClose(a + b + bias, actual)
+
+    def test_forward_grouped(self):
+        # more than 32 groups need several launches on the GPU
+        for num_groups in [1, 5, 40]:
+            self._forward_grouped(num_groups, use_gpu=False, force_gpu=False)
+            self._forward_grouped(num_groups, use_gpu=True, force_gpu=True)
+
+    def _backward_grouped(self, num_groups, use_gpu=False, force_gpu=False, dtype=np.float64):
+        shapes = self._grouped_shapes(num_groups)
+        matsA = [np.random.randn(*shape).astype(dtype) * 10 for shape in shapes]
+        matsB = [np.random.randn(*shape).astype(dtype) * 10 for shape in shapes]
+        bias = 42.
+
+        matA_ops = [tf.convert_to_tensor(m) for m in matsA]
+        matB_ops = [tf.convert_to_tensor(m) for m in matsB]
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_ops = matrix_add_grouped(matA_ops, matB_ops, bias)
+            # the (non-empty) last group
+            err = tf.test.compute_gradient_error(
+                [matA_ops[-1], matB_ops[-1]], [shapes[-1], shapes[-1]],
+                actual_ops[-1], shapes[-1])
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_grouped(self):
+        self._backward_grouped(3, use_gpu=False, force_gpu=False)
+        self._backward_grouped(3, use_gpu=True, force_gpu=True)
+
+    def _activation(self, x, activation, alpha):
+        if activation == 'relu':
+            return np.maximum(x, 0)
+        if activation == 'leaky_relu':
+            return np.where(x > 0, x, alpha * x)
+        if activation == 'gelu':
+            return 0.5 * x * (1 + np.tanh(np.sqrt(2 / np.pi) * (x + 0.044715 * x**3)))
+        return x
+
+    def _forward_activation(self, activation, use_gpu=False, force_gpu=False, dtype=np.float32,
+                            scale=1.):
+        matA = np.random.randn(2, 3, 4, 5).astype(dtype)
+        matB = np.random.randn(2, 3, 4, 5).astype(dtype)
+        bias = 0.5
+        alpha = 0.1
+
+        expected = self._activation(scale * (matA + matB) + bias, activation, alpha)
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = matrix_add(matA_op, matB_op, bias, activation=activation, alpha=alpha,
+                                   scale=scale)
+            actual = sess.run(actual_op)
+
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose(expected, actual, rtol=1e-5, atol=1e-5)
+
+    def test_forward_activation(self):
+        for activation in ['relu', 'leaky_relu', 'gelu']:
+            self._forward_activation(activation, use_gpu=False, force_gpu=False)
+            self._forward_activation(activation, use_gpu=True, force_gpu=True)
+
+    def test_forward_scale(self):
+        # the scale is applied to the sum, before the bias and the activation
+        for activation in ['none', 'relu', 'gelu']:
+            self._forward_activation(activation, use_gpu=False, force_gpu=False, scale=-1.5)
+            self._forward_activation(activation, use_gpu=True, force_gpu=True, scale=-1.5)
+
+    def _backward_activation(self, activation, use_gpu=False, force_gpu=False, dtype=np.float64,
+                             scale=1.):
+        matA = np.random.randn(2, 3, 4, 5).astype(dtype)
+        matB = np.random.randn(1, 1, 1, 5).astype(dtype)
+        bias = 0.5
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_op = matrix_add(matA_op, matB_op, bias, activation=activation, alpha=0.1,
+                                   scale=scale)
+            err = tf.test.compute_gradient_error(
+                [matA_op, matB_op], [matA.shape, matB.shape],
+                actual_op, matA.shape)
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_activation(self):
+        for activation in ['leaky_relu', 'gelu']:
+            self._backward_activation(activation, use_gpu=False, force_gpu=False)
+            self._backward_activation(activation, use_gpu=True, force_gpu=True)
+
+    def test_backward_scale(self):
+        for activation in ['none', 'leaky_relu', 'gelu']:
+            self._backward_activation(activation, use_gpu=False, force_gpu=False, scale=-1.5)
+            self._backward_activation(activation, use_gpu=True, force_gpu=True, scale=-1.5)
+
+    def test_forward_host(self):
+        # several chunks of the default 4 MiB, more than slots of the ring
+        for shape in [(2, 3, 4, 5), (4, 1000, 1000)]:
+            matA = np.random.randn(*shape).astype(np.float32)
+            matB = np.random.randn(*shape).astype(np.float32)
+
+            expected = self._activation(matA + matB + 0.5, 'relu', 0.)
+
+            with self.test_session(use_gpu=True, force_gpu=True) as sess:
+                with tf.device('/cpu:0'):
+                    matA_op = tf.identity(matA)
+                actual_op = matrix_add_host_a(matA_op, matB, 0.5, activation='relu')
+                actual = sess.run(actual_op)
+
+            self.assertAllClose(expected, actual)
+
+    def test_forward_host_reused_memory(self):
+        # "hidden" is freed once the second matmul is enqueued, the staging
+        # ring of the next op may get its memory while that matmul still
+        # reads it
+        matA = np.random.randn(4096, 1024).astype(np.float32)
+        matX = np.random.randn(4096, 1024).astype(np.float32)
+        matW = np.random.randn(1024, 1024).astype(np.float32) / 32
+
+        with self.test_session(use_gpu=True, force_gpu=True) as sess:
+            with tf.device('/cpu:0'):
+                matA_op = tf.identity(matA)
+            hidden = tf.matmul(matX, matW)
+            matB_op = tf.matmul(hidden, matW)
+            actual_op = matrix_add_host_a(matA_op, matB_op, 0.5)
+            for _ in range(3):
+                actual, matB = sess.run([actual_op, matB_op])
+                self.assertAllClose(matA + matB + 0.5, actual)
+
+    def _forward_v2(self, shape_bias, use_gpu=False, force_gpu=False, dtype=np.float32):
+        matA = np.random.randn(2, 3, 4, 5).astype(dtype)
+        matB = np.random.randn(1, 1, 4, 5).astype(dtype)
+        bias = np.asarray(np.random.randn(*shape_bias)).astype(dtype)
+        alpha = 0.1
+
+        expected = self._activation(matA + matB + bias, 'leaky_relu', alpha)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = matrix_add_v2(matA, matB, bias, activation='leaky_relu', alpha=alpha)
+            actual = sess.run(actual_op)
+
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose(expected, actual, rtol=1e-5, atol=1e-5)
+
+    def test_forward_v2(self):
+        for shape_bias in [(), (1,), (5,)]:
+            self._forward_v2(shape_bias, use_gpu=False, force_gpu=False)
+            self._forward_v2(shape_bias, use_gpu=True, force_gpu=True)
+
+    def _backward_v2(self, shape_bias, use_gpu=False, force_gpu=False, dtype=np.float64,
+                     scale=1.):
+        matA = np.random.randn(2, 3, 4, 5).astype(dtype)
+        matB = np.random.randn(1, 1, 4, 5).astype(dtype)
+        bias = np.asarray(np.random.randn(*shape_bias)).astype(dtype)
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+        bias_op = tf.convert_to_tensor(bias)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_op = matrix_add_v2(matA_op, matB_op, bias_op, activation='gelu', scale=scale)
+            err = tf.test.compute_gradient_error(
+                [matA_op, matB_op, bias_op], [matA.shape, matB.shape, bias.shape],
+                actual_op, matA.shape)
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_v2(self):
+        for shape_bias in [(), (5,)]:
+            self._backward_v2(shape_bias, use_gpu=False, force_gpu=False)
+            self._backward_v2(shape_bias, use_gpu=True, force_gpu=True)
+
+    def test_backward_v2_scale(self):
+        # the gradient of the bias is not scaled, the ones of the inputs are
+        for shape_bias in [(), (5,)]:
+            self._backward_v2(shape_bias, use_gpu=False, force_gpu=False, scale=2.)
+            self._backward_v2(shape_bias, use_gpu=True, force_gpu=True, scale=2.)
+
+    def _backward_sparse(self, activation, use_gpu=False, force_gpu=False, dtype=np.float64,
+                         scale=1.):
+        matA = np.random.randn(6, 4, 5).astype(dtype)
+        matB = np.random.randn(6, 4, 5).astype(dtype)
+        indices = np.array([4, 0, 4, 2], dtype=np.int32)
+        bias = 0.5
+        alpha = 0.1
+
+        x = scale * (matA + matB) + bias
+        slope = np.ones_like(x) if activation == 'none' else np.where(x > 0, 1, alpha)
+        slope *= scale
+        expected = np.zeros_like(x)
+        np.add.at(expected, indices, slope[indices])
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = matrix_add(matA_op, matB_op, bias, activation=activation, alpha=alpha,
+                                   scale=scale)
+            grads = tf.gradients(tf.gather(actual_op, indices), [matA_op, matB_op])
+            for grad in grads:
+                self.assertIsInstance(grad, tf.IndexedSlices)
+            actual = sess.run([tf.convert_to_tensor(grad) for grad in grads])
+
+        self.assertAllClose(expected, actual[0])
+        self.assertAllClose(expected, actual[1])
+
+    def test_backward_sparse(self):
+        for activation in ['none', 'leaky_relu']:
+            self._backward_sparse(activation, use_gpu=False, force_gpu=False)
+            self._backward_sparse(activation, use_gpu=True, force_gpu=True)
+            self._backward_sparse(activation, use_gpu=False, force_gpu=False, scale=-1.5)
+            self._backward_sparse(activation, use_gpu=True, force_gpu=True, scale=-1.5)
+
+    def _fusion(self, use_gpu=False, force_gpu=False, dtype=np.float32):
+        shape = (2, 3, 4, 5)
+        mats = [np.random.randn(*shape).astype(dtype) for _ in range(3)]
+        expected = np.maximum(mats[0] + mats[1] + 1. + mats[2] + 2., 0)
+
+        placeholders = [tf.placeholder(dtype, shape) for _ in mats]
+        feed_dict = dict(zip(placeholders, mats))
+        run_metadata = tf.RunMetadata()
+        options = tf.RunOptions(output_partition_graphs=True)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu,
+                               config=matrix_add_optimizer_config()) as sess:
+            actual_op = tf.nn.relu(matrix_add(matrix_add(placeholders[0], placeholders[1], 1.),
+                                              placeholders[2], 2.))
+            actual = sess.run(actual_op, feed_dict, options=options, run_metadata=run_metadata)
+
+        ops = [node.op for graph in run_metadata.partition_graphs for node in graph.node]
+        self.assertEqual(ops.count('MatrixAdd'), 1)
+        self.assertEqual(ops.count('MatrixAddN'), 1)
+        self.assertNotIn('Relu', ops)
+        self.assertAllClose(expected, actual)
+
+    def test_fusion(self):
+        self._fusion(use_gpu=False, force_gpu=False)
+        self._fusion(use_gpu=True, force_gpu=True)
+
+    def _fusion_n(self, use_gpu=False, force_gpu=False, dtype=np.float32):
+        # a graph without any "MatrixAdd" before the rewrite
+        shape = (2, 3, 4, 5)
+        mats = [np.random.randn(*shape).astype(dtype) for _ in range(3)]
+        expected = np.maximum(mats[0] + mats[1] + mats[2] + 1., 0)
+
+        placeholders = [tf.placeholder(dtype, shape) for _ in mats]
+        feed_dict = dict(zip(placeholders, mats))
+        run_metadata = tf.RunMetadata()
+        options = tf.RunOptions(output_partition_graphs=True)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu,
+                               config=matrix_add_optimizer_config()) as sess:
+            actual_op = tf.nn.relu(matrix_add_n(placeholders, 1.))
+            actual = sess.run(actual_op, feed_dict, options=options, run_metadata=run_metadata)
+
+        ops = [node.op for graph in run_metadata.partition_graphs for node in graph.node]
+        self.assertEqual(ops.count('MatrixAdd'), 1)
+        self.assertEqual(ops.count('MatrixAddN'), 1)
+        self.assertNotIn('Relu', ops)
+        self.assertAllClose(expected, actual)
+
+    def test_fusion_n(self):
+        self._fusion_n(use_gpu=False, force_gpu=False)
+        self._fusion_n(use_gpu=True, force_gpu=True)
+
+    def _forward_elementwise(self, op, reference, shape_b, use_gpu=False, force_gpu=False,
+                             dtype=np.float32, shape_a=(2, 3, 4, 5)):
+        matA = np.random.randn(*shape_a).astype(dtype)
+        matB = np.random.randn(*shape_b).astype(dtype)
+        bias = 0.5
+        alpha = 0.1
+
+        expected = self._activation(reference(matA, matB) + bias, 'leaky_relu', alpha)
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            actual_op = op(matA_op, matB_op, bias=bias, activation='leaky_relu', alpha=alpha)
+            actual = sess.run(actual_op)
+
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose(expected, actual, rtol=1e-5, atol=1e-5)
+
+    def test_forward_elementwise(self):
+        for op, reference in ELEMENTWISE_OPS:
+            for shape_b in [(2, 3, 4, 5), (1, 1, 1, 5)]:
+                self._forward_elementwise(op, reference, shape_b, use_gpu=False, force_gpu=False)
+                self._forward_elementwise(op, reference, shape_b, use_gpu=True, force_gpu=True)
+            # broadcasted although both inputs have the same size
+            for shape_a, shape_b in [((6,), (6, 1)), ((6, 1), (1, 6))]:
+                self._forward_elementwise(op, reference, shape_b, use_gpu=False, force_gpu=False,
+                                          shape_a=shape_a)
+                self._forward_elementwise(op, reference, shape_b, use_gpu=True, force_gpu=True,
+                                          shape_a=shape_a)
+
+    def _backward_elementwise(self, op, use_gpu=False, force_gpu=False, dtype=np.float64):
+        matA = np.random.randn(2, 3, 4, 5).astype(dtype)
+        matB = np.random.randn(1, 3, 1, 5).astype(dtype)
+
+        matA_op = tf.convert_to_tensor(matA)
+        matB_op = tf.convert_to_tensor(matB)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu):
+            actual_op = op(matA_op, matB_op, bias=0.5, activation='gelu')
+            err = tf.test.compute_gradient_error(
+                [matA_op, matB_op], [matA.shape, matB.shape],
+                actual_op, matA.shape)
+
+        self.assertLess(err, 1e-2)
+
+    def test_backward_elementwise(self):
+        for op, _ in ELEMENTWISE_OPS:
+            self._backward_elementwise(op, use_gpu=False, force_gpu=False)
+            self._backward_elementwise(op, use_gpu=True, force_gpu=True)
+
+    def _forward_quantized(self, dtype, activation, shape_b, use_gpu=False, force_gpu=False,
+                           shape_a=(2, 3, 4, 5)):
+        matA = np.random.uniform(-1, 3, shape_a).astype(np.float32)
+        matB = np.random.uniform(-2, 2, shape_b).astype(np.float32)
+        bias = 0.5
+        min_output, max_output = -3., 6.
+
+        expected = matA + matB + bias
+        if activation == 'relu':
+            expected = np.maximum(expected, 0)
+        expected = np.clip(expected, min_output, max_output)
+
+        with self.test_session(use_gpu=use_gpu, force_gpu=force_gpu) as sess:
+            qA, min_a, max_a = tf.quantize_v2(matA, -1., 3., dtype, mode='MIN_COMBINED')
+            qB, min_b, max_b = tf.quantize_v2(matB, -2., 2., dtype, mode='MIN_COMBINED')
+            qC, min_c, max_c = quantized_matrix_add(qA, qB, min_a, max_a, min_b, max_b,
+                                                    min_output, max_output, bias=bias,
+                                                    activation=activation)
+            actual_op = tf.dequantize(qC, min_c, max_c, mode='MIN_COMBINED')
+            actual, range_c = sess.run([actual_op, [min_c, max_c]])
+
+        # the rounding of both inputs and of the output
+        step = (max_output - min_output) / 255.
+        self.assertShapeEqual(expected, actual_op)
+        self.assertAllClose([min_output, max_output], range_c)
+        self.assertAllClose(expected, actual, rtol=0, atol=2 * step)
+
+    def test_forward_quantized(self):
+        for dtype in [tf.qint8, tf.quint8]:
+            for activation in ['none', 'relu']:
+                for shape_b in [(2, 3, 4, 5), (1, 1, 1, 5)]:
+                    self._forward_quantized(dtype, activation, shape_b,
+                                            use_gpu=False, force_gpu=False)
+                    self._forward_quantized(dtype, activation, shape_b,
+                                            use_gpu=True, force_gpu=True)
+            # broadcasted although both inputs have the same size
+            for shape_a, shape_b in [((6,), (6, 1)), ((1, 6), (6, 1))]:
+                self._forward_quantized(dtype, 'none', shape_b, use_gpu=False, force_gpu=False,
+                                        shape_a=shape_a)
+                self._forward_quantized(dtype, 'none', shape_b, use_gpu=True, force_gpu=True,
+                                        shape_a=shape_a)
+
+    def _quantized_devices(self, dtype, activation, N, ranges):
+        range_a, range_b, (min_output, max_output) = ranges
+        matA = np.random.uniform(range_a[0], range_a[1], N).astype(np.float32)
+        matB = np.random.uniform(range_b[0], range_b[1], N).astype(np.float32)
+
+        with self.test_session(use_gpu=True) as sess:
+            with tf.device('/cpu:0'):
+                qA, min_a, max_a = tf.quantize_v2(matA, range_a[0], range_a[1], dtype,
+                                                  mode='MIN_COMBINED')
+                qB, min_b, max_b = tf.quantize_v2(matB, range_b[0], range_b[1], dtype,
+                                                  mode='MIN_COMBINED')
+            outputs = []
+            for device in ['/cpu:0', '/gpu:0']:
+                with tf.device(device):
+                    qC, min_c, max_c = quantized_matrix_add(qA, qB, min_a, max_a, min_b, max_b,
+                                                            min_output, max_output, bias=0.25,
+                                                            activation=activation)
+                with tf.device('/cpu:0'):
+                    outputs.append(tf.dequantize(qC, min_c, max_c, mode='MIN_COMBINED'))
+            actual_cpu, actual_gpu = sess.run(outputs)
+
+        self.assertAllEqual(actual_cpu, actual_gpu)
+
+    def test_quantized_devices(self):
+        # the GPU gives the same bytes as the CPU, for aligned sizes (packed
+        # lanes) and odd ones (scalar tail)
+        ranges = [((-1., 3.), (-2., 2.), (-3., 6.)),
+                  ((0., 1.), (-50., 50.), (-60., 60.)),
+                  ((-0.01, 0.02), (-0.5, 0.25), (-1., 1.))]
+        for dtype in [tf.qint8, tf.quint8]:
+            for activation in ['none', 'relu']:
+                for N in [4096, 1037]:
+                    for r in ranges:
+                        self._quantized_devices(dtype, activation, N, r)
+
+    def test_load_library(self):
+        # all ops are in one library, which is loaded once
+        module = load_library()
+        self.assertIs(module, load_library())
+        for name in ['matrix_add', 'matrix_add_n', 'matrix_add_v2', 'quantized_matrix_add',
+                     'matrix_sub', 'matrix_mul', 'matrix_minimum', 'matrix_maximum']:
+            self.assertTrue(hasattr(module, name), name)
+        # the wrappers have the docstrings of the generated ops
+        self.assertEqual(matrix_add.__doc__, module.matrix_add.__doc__)
+
 
 if __name__ == '__main__':
     tf.test.main()
@@ -0,0 +1,237 @@
+// ComputerGraphics Tuebingen, 2018
+
+// Records the GPU functors of MatrixAdd, MatrixAddGrad and MatrixAddN into a
+// CUDA graph by stream capture, replays the graph and compares the outputs
+// with eager launches of the same functors (see the capture rules above the
+// functors in kernels/matrix_add_kernel.cu).
+//
+// The functors only use the Eigen device and the allocator of the
+// OpKernelContext, so the context is backed by a minimal device on a stream
+// of its own instead of a TensorFlow session. Exits with 0 (and a message)
+// if there is no GPU.
+
+#if GOOGLE_CUDA
+
+#define EIGEN_USE_GPU
+
+#include <cstdio>
+#include <vector>
+
+#include <cuda_runtime.h>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/device_base.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/logging.h"
+#include "matrix_add_op.h"
+
+#if CUDART_VERSION >= 10000
+
+namespace tensorflow {
+namespace {
+
+#define CUDA_CHECK(expr)                                              \
+  do {                                                                \
+    const cudaError_t err = (expr);                                   \
+    CHECK_EQ(err, cudaSuccess) << #expr << ": " << cudaGetErrorString(err); \
+  } while (0)
+
+// plain cudaMalloc, only used outside of the captured region
+class CudaAllocator : public Allocator {
+ public:
+  string Name() override { return "matrix_add_capture_test"; }
+
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override {
+    void* ptr = nullptr;
+    CUDA_CHECK(cudaMalloc(&ptr, num_bytes));
+    return ptr;
+  }
+
+  void DeallocateRaw(void* ptr) override { CUDA_CHECK(cudaFree(ptr)); }
+};
+
+class StreamGpuDevice : public PerOpGpuDevice {
+ public:
+  explicit StreamGpuDevice(const cudaStream_t* stream)
+    : stream_device_(stream, 0), device_(&stream_device_) {}
+
+  const Eigen::GpuDevice& device() const override { return device_; }
+
+ private:
+  Eigen::CudaStreamDevice stream_device_;
+  Eigen::GpuDevice device_;
+};
+
+// the Eigen device of every OpKernelContext enqueues on "stream"
+class StreamDevice : public DeviceBase {
+ public:
+  explicit StreamDevice(const cudaStream_t* stream)
+    : DeviceBase(Env::Default()), stream_(stream) {}
+
+  Allocator* GetAllocator(AllocatorAttributes) override { return &allocator_; }
+  PerOpGpuDevice* MakeGpuDevice() override { return new StreamGpuDevice(stream_); }
+
+ private:
+  const cudaStream_t* stream_;
+  CudaAllocator allocator_;
+};
+
+template <typename T>
+Tensor ToDevice(Allocator* allocator, const std::vector<T>& values) {
+  Tensor tensor(allocator, DataTypeToEnum<T>::value,
+                TensorShape({static_cast<int64>(values.size())}));
+  CUDA_CHECK(cudaMemcpy(tensor.flat<T>().data(), values.data(),
+                        values.size() * sizeof(T), cudaMemcpyHostToDevice));
+  return tensor;
+}
+
+template <typename T>
+std::vector<T> ToHost(const Tensor& tensor) {
+  std::vector<T> values(tensor.NumElements());
+  CUDA_CHECK(cudaMemcpy(values.data(), tensor.flat<T>().data(),
+                        values.size() * sizeof(T), cudaMemcpyDeviceToHost));
+  return values;
+}
+
+std::vector<float> Random(int N, int seed) {
+  std::vector<float> values(N);
+  unsigned int state = seed;
+  for (int i = 0; i < N; ++i) {
+    state = state * 1664525u + 1013904223u;
+    values[i] = static_cast<float>(state >> 8) / (1 << 24) * 20.f - 10.f;
+  }
+  return values;
+}
+
+void BeginCapture(cudaStream_t stream) {
+#if CUDART_VERSION >= 10010
+  CUDA_CHECK(cudaStreamBeginCapture(stream, cudaStreamCaptureModeGlobal));
+#else
+  CUDA_CHECK(cudaStreamBeginCapture(stream));
+#endif
+}
+
+// Runs "launch" once eagerly and once captured into a graph, clears the
+// outputs and replays the graph twice. "outputs" have to match afterwards.
+template <typename Launch>
+void CheckCapture(const char* name, cudaStream_t stream, const std::vector<Tensor*>& outputs,
+                  Launch launch) {
+  launch();
+  CUDA_CHECK(cudaStreamSynchronize(stream));
+  std::vector<std::vector<float> > eager;
+  for (const Tensor* output : outputs)
+    eager.push_back(ToHost<float>(*output));
+
+  cudaGraph_t graph;
+  BeginCapture(stream);
+  launch();
+  CUDA_CHECK(cudaStreamEndCapture(stream, &graph));
+
+  size_t num_nodes = 0;
+  CUDA_CHECK(cudaGraphGetNodes(graph, nullptr, &num_nodes));
+  CHECK_GT(num_nodes, 0) << name << ": nothing was captured";
+
+  cudaGraphExec_t exec;
+#if CUDART_VERSION >= 12000
+  CUDA_CHECK(cudaGraphInstantiate(&exec, graph, 0));
+#else
+  CUDA_CHECK(cudaGraphInstantiate(&exec, graph, nullptr, nullptr, 0));
+#endif
+
+  for (int replay = 0; replay < 2; ++replay) {
+    for (Tensor* output : outputs)
+      CUDA_CHECK(cudaMemsetAsync(output->flat<float>().data(), 0xff,
+                                 output->TotalBytes(), stream));
+    CUDA_CHECK(cudaGraphLaunch(exec, stream));
+    CUDA_CHECK(cudaStreamSynchronize(stream));
+
+    for (size_t k = 0; k < outputs.size(); ++k) {
+      const std::vector<float> replayed = ToHost<float>(*outputs[k]);
+      for (size_t i = 0; i < replayed.size(); ++i)
+        CHECK_EQ(eager[k][i], replayed[i]) << name << ": output " << k << ", element " << i;
+    }
+  }
+
+  CUDA_CHECK(cudaGraphExecDestroy(exec));
+  CUDA_CHECK(cudaGraphDestroy(graph));
+  std::printf("%s: %zu captured nodes, replay matches eager\n", name, num_nodes);
+}
+
+void Run() {
+  cudaStream_t stream;
+  CUDA_CHECK(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+
+  StreamDevice device(&stream);
+  Allocator* allocator = device.GetAllocator(AllocatorAttributes());
+
+  OpKernelContext::Params params;
+  params.device = &device;
+  OpKernelContext ctx(&params);
+  TF_CHECK_OK(ctx.status());
+
+  // odd sizes, which also run the scalar tails of the vectorized kernels
+  for (const int N : {1027, (1 << 20) + 3}) {
+    const Tensor mA = ToDevice(allocator, Random(N, 1));
+    const Tensor mB = ToDevice(allocator, Random(N, 2));
+    const Tensor mD = ToDevice(allocator, Random(N, 3));
+
+    for (const functor::Activation activation :
+         {functor::Activation::kNone, functor::Activation::kRelu}) {
+      const functor::Epilogue epilogue = {activation, 0.2f, 1.f};
+      Tensor mC(allocator, DT_FLOAT, mA.shape());
+      CheckCapture(activation == functor::Activation::kNone ? "MatrixAdd" : "MatrixAdd relu",
+                   stream, {&mC}, [&]() {
+        functor::MatrixAddFunctor<GPUDevice, float>()(&ctx, mA, mB, &mC, 42.f, epilogue);
+      });
+    }
+
+    // both gradients in fresh buffers (a single kernel) ...
+    Tensor grad_mA(allocator, DT_FLOAT, mA.shape());
+    Tensor grad_mB(allocator, DT_FLOAT, mA.shape());
+    CheckCapture("MatrixAddGrad", stream, {&grad_mA, &grad_mB}, [&]() {
+      functor::MatrixAddGrad<GPUDevice, float>()(&ctx, mD, &grad_mA, &grad_mB);
+    });
+
+    // ... and one of them forwarded from "topdiff" (an asynchronous copy)
+    Tensor topdiff(allocator, DT_FLOAT, mA.shape());
+    CUDA_CHECK(cudaMemcpy(topdiff.flat<float>().data(), mD.flat<float>().data(),
+                          mD.TotalBytes(), cudaMemcpyDeviceToDevice));
+    Tensor forwarded = topdiff;
+    CheckCapture("MatrixAddGrad forwarded", stream, {&grad_mB}, [&]() {
+      functor::MatrixAddGrad<GPUDevice, float>()(&ctx, topdiff, &forwarded, &grad_mB);
+    });
+
+    Tensor mN(allocator, DT_FLOAT, mA.shape());
+    CheckCapture("MatrixAddN", stream, {&mN}, [&]() {
+      functor::MatrixAddNFunctor<GPUDevice, float>()(&ctx, {&mA, &mB, &mD}, &mN, 1.f);
+    });
+  }
+
+  CUDA_CHECK(cudaStreamDestroy(stream));
+}
+
+}  // namespace
+}  // namespace tensorflow
+
+int main() {
+  int devices = 0;
+  if (cudaGetDeviceCount(&devices) != cudaSuccess || devices == 0) {
+    std::printf("no GPU, skipped\n");
+    return 0;
+  }
+  ::tensorflow::Run();
+  return 0;
+}
+
+#else  // CUDART_VERSION >= 10000
+
+int main() {
+  std::printf("stream capture requires CUDA 10.0 or newer, skipped\n");
+  return 0;
+}
+
+#endif  // CUDART_VERSION >= 10000
+
+#endif  // GOOGLE_CUDA
@@ -0,0 +1,191 @@
+#!/usr/bin/env python
+# ComputerGraphics Tuebingen, 2018
+
+"""Sweep of the kernel variants over sizes, shapes, dtypes and devices.
+
+Odd sizes end in the scalar tails of the vectorized kernels, large ones are
+split into several shards on the CPU and several grid-stride iterations on
+the GPU. Every case is also timed (best of a few runs of the op alone):
+
+  MATRIX_ADD_PERF_REPORT=<file>    writes the times of all cases as JSON
+  MATRIX_ADD_PERF_BASELINE=<file>  fails cases which are slower than in a
+                                   previous report by more than the factor
+  MATRIX_ADD_PERF_TOLERANCE=<f>    (default 1.5)
+
+All inputs are drawn from a fixed seed, so two runs compute the same cases.
+"""
+
+import json
+import os
+import time
+import zlib
+
+import numpy as np
+import tensorflow as tf
+from __init__ import matrix_add, matrix_add_n, matrix_maximum, matrix_sub
+
+# number of elements of the flat cases
+SIZES = [1, 3, 7, 15, 17, 31, 33, 255, 257, 4097, 65537]
+# only float32 is swept with outputs this large
+LARGE_SIZES = [(1 << 20) + 3, (1 << 22) + 5]
+
+BROADCAST_SHAPES = [((5, 7), (1, 7)),
+                    ((5, 7), (5, 1)),
+                    ((3, 1, 9), (1, 4, 1)),
+                    ((2, 3, 5, 7), (7,)),
+                    ((1029,), ()),
+                    ((33, 65), (33, 1)),
+                    # broadcasted although both inputs have the same size
+                    ((6,), (6, 1)),
+                    ((1, 6), (6, 1))]
+
+DTYPES = [tf.int32, tf.float32, tf.float64, tf.float16, tf.bfloat16]
+
+TOLERANCE = {tf.int32: 0, tf.float32: 1e-5, tf.float64: 1e-10,
+             tf.float16: 2e-2, tf.bfloat16: 1e-1}
+
+# types without GPU variables, their inputs are copied to the GPU per run
+HOST_DTYPES = [tf.int32, tf.bfloat16]
+
+REPEATS = 3
+# timer noise of tiny cases (in seconds), which is not a regression
+ABSOLUTE_SLACK = 2e-3
+
+_timings = {}
+
+
+def _load_baseline():
+    path = os.environ.get('MATRIX_ADD_PERF_BASELINE')
+    if not path:
+        return {}
+    with open(path) as f:
+        return json.load(f)
+
+
+_baseline = _load_baseline()
+_tolerance = float(os.environ.get('MATRIX_ADD_PERF_TOLERANCE', '1.5'))
+
+
+def _random(shape, dtype, rng):
+    if dtype == tf.int32:
+        return rng.randint(-100, 100, size=shape).astype(np.int32)
+    return rng.randn(*shape).astype(np.float32)
+
+
+class MatrixAddSweepTest(tf.test.TestCase):
+
+    @classmethod
+    def tearDownClass(cls):
+        path = os.environ.get('MATRIX_ADD_PERF_REPORT')
+        if path:
+            with open(path, 'w') as f:
+                json.dump(_timings, f, indent=2, sort_keys=True)
+
+    def _check(self, name, op, reference, shapes, dtype, use_gpu, rtol=None):
+        """Compares `op(*inputs)` with `reference(*inputs)` in float64 and times it.
+
+        The inputs are variables, so the op is neither constant folded nor
+        timed together with feeding its inputs.
+        """
+        device = 'gpu' if use_gpu else 'cpu'
+        key = '%s/%s/%s/%s' % (name, device, dtype.name, 'x'.join(str(list(s)) for s in shapes))
+        rng = np.random.RandomState(zlib.crc32(key.encode()))
+        rtol = TOLERANCE[dtype] if rtol is None else rtol
+
+        graph = tf.Graph()
+        with graph.as_default():
+            with self.test_session(graph=graph, use_gpu=use_gpu, force_gpu=use_gpu) as sess:
+                with tf.device('/cpu:0' if dtype in HOST_DTYPES else None):
+                    inputs = [tf.Variable(tf.cast(_random(s, dtype, rng), dtype))
+                              for s in shapes]
+                actual_op = op(*inputs)
+                sess.run(tf.global_variables_initializer())
+
+                values = sess.run([tf.cast(x, tf.float64) for x in inputs])
+                actual = sess.run(tf.cast(actual_op, tf.float64))
+
+                best = None
+                for _ in range(REPEATS):
+                    start = time.time()
+                    sess.run(actual_op.op)
+                    elapsed = time.time() - start
+                    best = elapsed if best is None else min(best, elapsed)
+
+        expected = reference(*values)
+        self.assertEqual(expected.shape, actual.shape, key)
+        self.assertAllClose(expected, actual, rtol=rtol, atol=rtol, msg=key)
+
+        _timings[key] = best
+        if key in _baseline:
+            limit = _baseline[key] * _tolerance + ABSOLUTE_SLACK
+            self.assertLess(best, limit, '%s: %.3f ms, baseline %.3f ms' % (
+                key, best * 1e3, _baseline[key] * 1e3))
+
+    def test_flat(self):
+        for use_gpu in [False, True]:
+            for dtype in DTYPES:
+                for size in SIZES:
+                    self._check('matrix_add', lambda a, b: matrix_add(a, b, 1.),
+                                lambda a, b: a + b + 1., [(size,), (size,)], dtype, use_gpu)
+            for size in LARGE_SIZES:
+                self._check('matrix_add', lambda a, b: matrix_add(a, b, 1.),
+                            lambda a, b: a + b + 1., [(size,), (size,)], tf.float32, use_gpu)
+
+    def test_flat_activation(self):
+        alpha = 0.1
+        for use_gpu in [False, True]:
+            for dtype in [tf.float32, tf.float16]:
+                for size in [17, 4097, 65537]:
+                    self._check('matrix_add_leaky_relu',
+                                lambda a, b: matrix_add(a, b, .5, activation='leaky_relu',
+                                                        alpha=alpha),
+                                lambda a, b: np.where(a + b + .5 > 0, a + b + .5,
+                                                      alpha * (a + b + .5)),
+                                [(size,), (size,)], dtype, use_gpu)
+
+    def test_broadcast(self):
+        for use_gpu in [False, True]:
+            for dtype in DTYPES:
+                for shape_a, shape_b in BROADCAST_SHAPES:
+                    self._check('matrix_add', lambda a, b: matrix_add(a, b, 1.),
+                                lambda a, b: a + b + 1., [shape_a, shape_b], dtype, use_gpu)
+                    # the input of the larger shape second
+                    self._check('matrix_add', lambda a, b: matrix_add(a, b, 1.),
+                                lambda a, b: a + b + 1., [shape_b, shape_a], dtype, use_gpu)
+
+    def test_n(self):
+        for use_gpu in [False, True]:
+            for dtype in DTYPES:
+                for size in SIZES:
+                    self._check('matrix_add_n', lambda a, b, c: matrix_add_n([a, b, c], 1.),
+                                lambda a, b, c: a + b + c + 1., [(size,)] * 3, dtype, use_gpu)
+
+    def test_elementwise(self):
+        for use_gpu in [False, True]:
+            for dtype in DTYPES:
+                for shape_a, shape_b in [((4097,), (4097,))] + BROADCAST_SHAPES:
+                    self._check('matrix_sub', lambda a, b: matrix_sub(a, b),
+                                np.subtract, [shape_a, shape_b], dtype, use_gpu)
+                    self._check('matrix_maximum', lambda a, b: matrix_maximum(a, b),
+                                np.maximum, [shape_a, shape_b], dtype, use_gpu)
+
+    def test_backward_broadcast(self):
+        def reduce_to(grad, shape):
+            # sum over the broadcasted axes like numpy broadcasting
+            grad = grad.sum(axis=tuple(range(grad.ndim - len(shape))))
+            axes = tuple(k for k, d in enumerate(shape) if d == 1)
+            return grad.sum(axis=axes, keepdims=True).reshape(shape)
+
+        for use_gpu in [False, True]:
+            for dtype in [tf.float32, tf.float64]:
+                for shape_a, shape_b in BROADCAST_SHAPES:
+                    # the gradient of the sum of squares is 2 * (a + b)
+                    self._check('matrix_add_grad_b',
+                                lambda a, b: tf.gradients(
+                                    tf.reduce_sum(tf.square(matrix_add(a, b, 0.))), b)[0],
+                                lambda a, b: reduce_to(2 * (a + b), b.shape),
+                                [shape_a, shape_b], dtype, use_gpu, rtol=1e-4)
+
+
+if __name__ == '__main__':
+    tf.test.main()